@@ -0,0 +1,228 @@
+#include "Assembler.h"
+
+#include <algorithm> // std::min, std::stable_sort
+#include <cstdio>    // fopen, fwrite
+#include <istream>   // std::istream
+#include <iterator>  // std::istreambuf_iterator
+#include <utility>   // std::move
+#include <fcntl.h>   // open
+#include <unistd.h>  // pwrite, ftruncate, close
+
+#include "Parser.h"
+#include "Stats.h"
+#include "debug.h"
+#include "utility.h"
+
+static std::string plural(std::size_t count, const char* word) {
+    return std::to_string(count) + " " + word + (count == 1 ? "" : "s");
+}
+
+// a note for every dead range of code and unused data, and one about what
+//  removing all of it saves
+static void handle_dead_code(Parser& parser, bool remove, std::vector<Diagnostic>& notes) {
+    const DeadCode    dead         = parser.find_dead_code();
+    const Program&    program      = parser.program();
+    const std::size_t first_note   = notes.size();
+    std::size_t       instructions = 0;
+    for (const auto& [first, last] : dead.code) {
+        std::string message = plural(last - first, "unreachable instruction");
+        if (program.loc(last - 1).line != program.loc(first).line) {
+            message += ", up to line " + std::to_string(program.loc(last - 1).line);
+        }
+        notes.push_back(Diagnostic { program.loc(first), std::move(message) });
+        instructions += last - first;
+    }
+    for (std::size_t i : dead.data) {
+        const std::string_view name = trim_whitespace(program.arg(i).substr(0, program.arg(i).find('=')));
+        notes.push_back(Diagnostic { program.loc(i), "data '" + std::string(name) + "' is never used" });
+    }
+    if (instructions == 0 && dead.data.empty()) {
+        return;
+    }
+    std::stable_sort(notes.begin() + static_cast<std::ptrdiff_t>(first_note), notes.end(), [](const Diagnostic& a, const Diagnostic& b) {
+        return a.loc.line < b.loc.line;
+    });
+    const std::size_t words = program.size();
+    std::string       summary = (remove ? "removed " : "found ") + plural(instructions, "unreachable instruction") + " and "
+        + plural(dead.data.size(), "unused data word") + ", " + std::to_string(instructions + dead.data.size()) + " of "
+        + std::to_string(words) + " words";
+    if (!dead.jumps.empty()) {
+        // dead code never runs, the jumps over it do
+        summary += (remove ? ", and " : ", removing them also removes ") + plural(dead.jumps.size(), "jump")
+            + " over them, a cycle every time one runs";
+    }
+    notes.push_back(Diagnostic { source_location_t { 0, 0 }, std::move(summary) });
+    if (remove) {
+        parser.remove_dead_code(dead);
+    }
+}
+
+static AssemblyResult assemble_with(Parser& parser, const AssemblyOptions& options) {
+    AssemblyResult result;
+    if (parser.invalid()) {
+        result.status      = AssemblyStatus::Failed;
+        result.diagnostics = parser.diagnostics();
+        return result;
+    }
+    {
+        PhaseTimer timer(StatPhase::Transform);
+        if (options.dead_code != DeadCodeMode::Keep) {
+            handle_dead_code(parser, options.dead_code == DeadCodeMode::Remove, result.notes);
+        }
+        if (options.relocate_data) {
+            parser.relocate_data();
+        }
+        if (options.merge_constants) {
+            parser.merge_constants();
+        }
+        if (options.inline_size > 0) {
+            parser.inline_calls(options.inline_size);
+        }
+        if (options.superopt_length > 0) {
+            parser.superoptimize(options.superopt_length, options.superopt_database, options.superopt_threads);
+        }
+        if (options.optimize) {
+            parser.thread_jumps();
+            parser.optimize();
+        }
+    }
+    {
+        PhaseTimer timer(StatPhase::Encode);
+        parser.parse_all();
+    }
+    if (parser.invalid()) {
+        result.status = AssemblyStatus::Errors;
+    }
+    result.image       = parser.image();
+    result.diagnostics = parser.diagnostics();
+    for (const Symbol& symbol : parser.symbols()) {
+        // calls declare data named after the address they return to, and
+        //  the return stack declares data of its own
+        if (symbol.kind != SymbolKind::Data || symbol.removed || symbol.line == 0 || symbol.name.starts_with("__pc__"))
+            continue;
+        result.data.push_back(DataSymbol { std::string(symbol.name), symbol.address, symbol.value });
+    }
+    PhaseTimer timer(StatPhase::Listing);
+    if (options.debug_info) {
+        result.debug_info = parser.debug_info();
+    }
+    if (options.listing) {
+        if (options.annotate_listing) {
+            const ControlFlow flow = parser.control_flow();
+            parser.write_listing(result.listing, &flow);
+        } else {
+            parser.write_listing(result.listing);
+        }
+    }
+    return result;
+}
+
+CallCost call_cost(CallConvention calls) {
+    switch (calls) {
+    case CallConvention::Inline:
+        // the call skips over its data, ret jumps to SUBR_PC_LOC and on from there
+        return CallCost { 6 + 2, 7 };
+    case CallConvention::Stack:
+        // the call and .__push, ret and .__ret and the jump on the stack,
+        //  plus the constant of the return address
+        return CallCost { 5 + 6 + 1 + 8 + 1, 5 + 1 };
+    }
+    return CallCost { 0, 0 };
+}
+
+const char* assembler_version() {
+    return MU0ASM_VERSION;
+}
+
+AssemblyResult assemble(std::string_view source, const AssemblyOptions& options) {
+    // the parser only lives for this call, so it can work on the caller's memory directly
+    SourceBuffer buffer;
+    buffer.wrap(source);
+    Parser parser(std::move(buffer), options.calls, options.parse_threads);
+    return assemble_with(parser, options);
+}
+
+AssemblyResult assemble(std::istream& input, const AssemblyOptions& options) {
+    SourceBuffer buffer;
+    buffer.assign(std::string(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>()));
+    Parser parser(std::move(buffer), options.calls, options.parse_threads);
+    return assemble_with(parser, options);
+}
+
+AssemblyResult assemble_file(const std::string& filename, const AssemblyOptions& options) {
+    Parser parser(filename, options.calls, options.parse_threads);
+    return assemble_with(parser, options);
+}
+
+std::string format_diagnostic(std::string_view source_name, const Diagnostic& diagnostic, const char* severity) {
+    std::string result(source_name);
+    if (diagnostic.loc.line != 0) {
+        result += ':';
+        result += std::to_string(diagnostic.loc.line);
+        result += ':';
+        result += std::to_string(diagnostic.loc.column);
+    }
+    result += ": ";
+    result += severity;
+    result += ": ";
+    result += diagnostic.message;
+    return result;
+}
+
+bool write_image(const std::string& filename, const std::vector<std::uint16_t>& image) {
+    FILE* fp = fopen(filename.c_str(), "wb");
+    if (!fp) {
+        error("file could not be openend for write: '" << filename << "'. error reported as: '");
+        perror("fopen");
+        return false;
+    }
+    bool ok = fwrite(image.data(), sizeof(std::uint16_t), image.size(), fp) == image.size();
+    return fclose(fp) == 0 && ok;
+}
+
+bool write_text(const std::string& filename, std::string_view text) {
+    FILE* fp = fopen(filename.c_str(), "wb");
+    if (!fp) {
+        error("could not open file '" << filename << "'");
+        return false;
+    }
+    bool ok = fwrite(text.data(), 1, text.size(), fp) == text.size();
+    return fclose(fp) == 0 && ok;
+}
+
+long patch_image(const std::string& filename, const std::vector<std::uint16_t>& old_image,
+                 const std::vector<std::uint16_t>& new_image) {
+    int fd = open(filename.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) {
+        error("file could not be openend for write: '" << filename << "'");
+        return -1;
+    }
+    constexpr std::size_t word_size = sizeof(std::uint16_t);
+    const std::size_t     common    = std::min(old_image.size(), new_image.size());
+    long                  written   = 0;
+    bool                  ok        = true;
+    // write each run of differing words with one call
+    for (std::size_t i = 0; ok && i < new_image.size();) {
+        if (i < common && old_image[i] == new_image[i]) {
+            ++i;
+            continue;
+        }
+        std::size_t end = i + 1;
+        while (end < new_image.size() && (end >= common || old_image[end] != new_image[end])) {
+            ++end;
+        }
+        const std::size_t bytes = (end - i) * word_size;
+        ok = pwrite(fd, new_image.data() + i, bytes, static_cast<off_t>(i * word_size)) == static_cast<ssize_t>(bytes);
+        written += static_cast<long>(end - i);
+        i = end;
+    }
+    if (ok && new_image.size() < old_image.size()) {
+        ok = ftruncate(fd, static_cast<off_t>(new_image.size() * word_size)) == 0;
+    }
+    ok = close(fd) == 0 && ok;
+    if (!ok) {
+        error("could not write to '" << filename << "'");
+        return -1;
+    }
+    return written;
+}
@@ -0,0 +1,132 @@
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include <cstdint>     // std::uint...
+#include <iosfwd>      // std::istream
+#include <string>      // std::string
+#include <string_view> // std::string_view
+#include <vector>      // std::vector
+#include "DebugInfo.h"
+#include "Diagnostic.h"
+
+// the library interface of the assembler. assemble() works entirely in
+// memory, nothing is read from or written to the filesystem.
+
+enum class AssemblyStatus
+{
+    // assembled without errors
+    Ok,
+    // errors while assembling, the image is complete but likely wrong
+    Errors,
+    // errors during initial parsing, there is no image
+    Failed,
+};
+
+// what to do about code that can't run and data nothing uses
+enum class DeadCodeMode : std::uint8_t
+{
+    Keep,
+    // add notes about it to the result
+    Report,
+    // add notes about it, and remove it
+    Remove,
+};
+
+class SuperoptDatabase;
+
+struct AssemblyOptions {
+    // also generate the listing, as written to a.asm
+    bool listing = false;
+    // start every basic block of the listing with what it costs and where
+    //  it goes, see Parser::control_flow
+    bool annotate_listing = false;
+    // also generate the debug info, as written to a.dbg
+    bool debug_info = false;
+    // remove instructions that don't change what the program does, see Parser::optimize
+    bool optimize = false;
+    // replace calls of leaf subroutines of up to this many instructions with
+    //  their body, 0 turns it off. see Parser::inline_calls
+    std::size_t inline_size = 0;
+    // keep only one word of every value declared as data that the program
+    //  never stores to, see Parser::merge_constants
+    bool merge_constants = false;
+    // move data out of the way of the code, see Parser::relocate_data
+    bool relocate_data = false;
+    // see Parser::find_dead_code
+    DeadCodeMode dead_code = DeadCodeMode::Keep;
+    // longest run of lda, sto, add and sub to find a shorter one for, 0
+    //  turns it off. see Parser::superoptimize
+    std::size_t superopt_length = 0;
+    // runs searched before, which new ones are added to. may be nullptr
+    SuperoptDatabase* superopt_database = nullptr;
+    // threads the searches run on, 0 is one per core
+    std::size_t superopt_threads = 1;
+    // threads a large source is parsed and encoded on, 0 is one per core.
+    //  the result doesn't depend on it
+    std::size_t parse_threads = 1;
+    CallConvention calls = CallConvention::Inline;
+};
+
+// a `d` declaration of the source
+struct DataSymbol {
+    std::string   name;
+    std::uint32_t address;
+    std::uint16_t value;
+};
+
+struct AssemblyResult {
+    AssemblyStatus             status = AssemblyStatus::Ok;
+    std::vector<std::uint16_t> image;
+    std::vector<Diagnostic>    diagnostics;
+    // things worth knowing that aren't errors, like dead code
+    std::vector<Diagnostic>    notes;
+    std::string                listing;
+    DebugInfo                  debug_info;
+    // without the ones the assembler declares itself
+    std::vector<DataSymbol> data;
+
+    bool ok() const {
+        return status == AssemblyStatus::Ok;
+    }
+    // nullptr if there is no data of that name
+    const DataSymbol* find_data(std::string_view name) const {
+        for (const DataSymbol& symbol : data) {
+            if (symbol.name == name)
+                return &symbol;
+        }
+        return nullptr;
+    }
+};
+
+// what a call costs with a calling convention
+struct CallCost {
+    // cycles of the call and its ret together
+    unsigned cycles;
+    // words of every call, without the ones all calls share
+    unsigned words;
+};
+
+CallCost call_cost(CallConvention calls);
+
+// version of the assembler, which is part of the key of cached results
+//  together with a hash of the running executable
+const char* assembler_version();
+
+AssemblyResult assemble(std::string_view source, const AssemblyOptions& options = {});
+AssemblyResult assemble(std::istream& input, const AssemblyOptions& options = {});
+// maps the file instead of copying it into memory first
+AssemblyResult assemble_file(const std::string& filename, const AssemblyOptions& options = {});
+
+// 'name:line:column: error: message', or without line and column if the
+//  diagnostic is about the whole source. notes say 'note' instead of 'error'
+std::string format_diagnostic(std::string_view source_name, const Diagnostic& diagnostic, const char* severity = "error");
+
+// writes the image the same way Parser::write_to does
+bool write_image(const std::string& filename, const std::vector<std::uint16_t>& image);
+bool write_text(const std::string& filename, std::string_view text);
+// turns a file written from old_image into new_image by only writing the
+//  words that differ. returns the number of words written, or -1 on error
+long patch_image(const std::string& filename, const std::vector<std::uint16_t>& old_image,
+                 const std::vector<std::uint16_t>& new_image);
+
+#endif // ASSEMBLER_H
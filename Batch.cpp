@@ -0,0 +1,182 @@
+#include "Batch.h"
+
+#include <algorithm> // std::min
+#include <array>     // std::array
+#include <chrono>    // std::chrono
+#include <utility>   // std::move
+
+#include "ThreadPool.h"
+#include "arch.h"
+
+// one word (or count) per lane of a group. these are GNU vector types, so
+//  every operation on them is a single SSE/AVX operation (or a few, if the
+//  target has narrower vectors)
+using Lanes       = std::uint16_t __attribute__((vector_size(BatchMachine::WIDTH * sizeof(std::uint16_t))));
+using SignedLanes = std::int16_t __attribute__((vector_size(BatchMachine::WIDTH * sizeof(std::int16_t))));
+using Counts      = std::uint64_t __attribute__((vector_size(BatchMachine::WIDTH * sizeof(std::uint64_t))));
+
+static constexpr std::size_t MEMORY_WORDS = Machine::MEMORY_WORDS;
+// lanes per task when running on more than one thread
+static constexpr std::size_t LANES_PER_TASK = 64 * BatchMachine::WIDTH;
+
+// macros rather than functions: passing or returning a vector by value
+//  changes the ABI depending on whether the target has AVX, so vectors
+//  never cross a call
+#define splat(value) (Lanes {} + static_cast<std::uint16_t>(value))
+// comparisons give -1 for true and 0 for false, which is all bits set or none
+#define mask_of(comparison) __builtin_convertvector((comparison), Lanes)
+#define select_lanes(mask, if_set, otherwise) (((if_set) & (mask)) | ((otherwise) & ~(mask)))
+
+bool BatchMachine::load(const std::vector<std::uint16_t>& image, std::vector<std::uint16_t> inputs,
+                        std::vector<std::uint16_t> outputs) {
+    if (image.size() > MEMORY_WORDS) {
+        return false;
+    }
+    m_image = image;
+    m_image.resize(MEMORY_WORDS, 0);
+    m_inputs  = std::move(inputs);
+    m_outputs = std::move(outputs);
+    for (std::uint16_t& address : m_inputs) {
+        address %= MEMORY_WORDS;
+    }
+    for (std::uint16_t& address : m_outputs) {
+        address %= MEMORY_WORDS;
+    }
+    return true;
+}
+
+BatchResult BatchMachine::run(const std::vector<std::uint16_t>& values, std::uint64_t max_steps,
+                              std::size_t thread_count) const {
+    BatchResult       result;
+    auto              start = std::chrono::steady_clock::now();
+    const std::size_t lanes = m_inputs.empty() ? 0 : values.size() / m_inputs.size();
+    result.lanes.resize(lanes);
+    result.outputs.resize(lanes * m_outputs.size());
+    if (thread_count == 1 || lanes <= LANES_PER_TASK) {
+        run_lanes(values, 0, lanes, max_steps, result);
+    } else {
+        // every task writes its own part of the result
+        ThreadPool pool(thread_count);
+        for (std::size_t first = 0; first < lanes; first += LANES_PER_TASK) {
+            pool.submit([&, first] {
+                run_lanes(values, first, std::min(first + LANES_PER_TASK, lanes), max_steps, result);
+            });
+        }
+        pool.wait();
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+void BatchMachine::run_lanes(const std::vector<std::uint16_t>& values, std::size_t first_lane, std::size_t last_lane,
+                             std::uint64_t max_steps, BatchResult& result) const {
+    // memory is stored address-major, so the words of all lanes at one
+    //  address are a single vector
+    std::vector<Lanes> memory(MEMORY_WORDS);
+    for (std::size_t i = 0; i < MEMORY_WORDS; ++i) {
+        memory[i] = splat(m_image[i]);
+    }
+    // addresses a group wrote to, which are all the next group has to reset
+    std::vector<std::uint16_t> dirty;
+    std::vector<bool>          is_dirty(MEMORY_WORDS, false);
+    auto                       mark_dirty = [&](std::uint16_t address) {
+        if (!is_dirty[address]) {
+            is_dirty[address] = true;
+            dirty.push_back(address);
+        }
+    };
+
+    for (std::size_t group = first_lane; group < last_lane; group += WIDTH) {
+        const std::size_t count = std::min(WIDTH, last_lane - group);
+        for (std::size_t i = 0; i < m_inputs.size(); ++i) {
+            const std::uint16_t address = m_inputs[i];
+            for (std::size_t lane = 0; lane < count; ++lane) {
+                memory[address][lane] = values[(group + lane) * m_inputs.size() + i];
+            }
+            mark_dirty(address);
+        }
+
+        Lanes  acc {};
+        Lanes  pc {};
+        Counts steps {};
+        Lanes  running {};
+        for (std::size_t lane = 0; lane < count; ++lane) {
+            running[lane] = 0xffff;
+        }
+        // lanes still running at the end ran out of steps
+        std::array<StopReason, WIDTH> reasons;
+        reasons.fill(StopReason::StepLimit);
+
+        while (true) {
+            running &= ~mask_of(__builtin_convertvector(steps >= max_steps, SignedLanes));
+            // the lowest pc goes first, so lanes that took a branch forward
+            //  wait for the others to catch up
+            std::size_t leader = WIDTH;
+            for (std::size_t lane = 0; lane < count; ++lane) {
+                if (running[lane] && (leader == WIDTH || pc[lane] < pc[leader]))
+                    leader = lane;
+            }
+            if (leader == WIDTH) {
+                break;
+            }
+            const std::uint16_t address = pc[leader];
+            const std::uint16_t word    = memory[address][leader];
+            const std::uint16_t operand = word & 0xfff;
+            // lanes that modified this instruction have to wait for a step of their own
+            const Lanes active = running & mask_of(pc == address) & mask_of(memory[address] == word);
+            Lanes       next   = splat(static_cast<std::uint16_t>((address + 1) % MEMORY_WORDS));
+
+            switch (word >> 12) {
+            case LDA:
+                acc = select_lanes(active, memory[operand], acc);
+                break;
+            case STO:
+                memory[operand] = select_lanes(active, acc, memory[operand]);
+                mark_dirty(operand);
+                break;
+            case ADD:
+                acc = select_lanes(active, acc + memory[operand], acc);
+                break;
+            case SUB:
+                acc = select_lanes(active, acc - memory[operand], acc);
+                break;
+            case JMP:
+                next = splat(operand);
+                break;
+            case JGE:
+                next = select_lanes(mask_of(__builtin_convertvector(acc, SignedLanes) >= 0), splat(operand), next);
+                break;
+            case JNE:
+                next = select_lanes(mask_of(acc != 0), splat(operand), next);
+                break;
+            default:
+                // a stopped lane stays on the instruction it stopped at
+                next = splat(address);
+                for (std::size_t lane = 0; lane < count; ++lane) {
+                    if (active[lane])
+                        reasons[lane] = (word >> 12) == STP ? StopReason::Stopped : StopReason::InvalidOpcode;
+                }
+                running &= ~active;
+                break;
+            }
+            pc = select_lanes(active, next, pc);
+            steps += __builtin_convertvector(active & 1, Counts);
+        }
+
+        for (std::size_t lane = 0; lane < count; ++lane) {
+            result.lanes[group + lane] = LaneResult { reasons[lane], acc[lane], pc[lane], steps[lane] };
+            for (std::size_t i = 0; i < m_outputs.size(); ++i) {
+                result.outputs[(group + lane) * m_outputs.size() + i] = memory[m_outputs[i]][lane];
+            }
+        }
+        for (std::uint16_t address : dirty) {
+            memory[address]   = splat(m_image[address]);
+            is_dirty[address] = false;
+        }
+        dirty.clear();
+    }
+}
+
+#undef splat
+#undef mask_of
+#undef select_lanes
@@ -0,0 +1,60 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uint...
+#include <vector>  // std::vector
+#include "Machine.h"
+
+struct LaneResult {
+    StopReason    reason = StopReason::Stopped;
+    std::uint16_t acc    = 0;
+    std::uint16_t pc     = 0;
+    // one instruction is one cycle
+    std::uint64_t steps = 0;
+};
+
+struct BatchResult {
+    std::vector<LaneResult> lanes;
+    // the words at the output addresses once a lane stopped, one row of
+    //  outputs per lane
+    std::vector<std::uint16_t> outputs;
+    double                     seconds = 0;
+};
+
+// runs one program over many sets of data. every lane is a machine of its
+// own, starting with the same image but different words at the input
+// addresses (usually the addresses of `d` declarations, see
+// AssemblyResult::data).
+//
+// lanes run in groups of WIDTH in lock-step: each step executes one
+// instruction on every lane of the group that's at the same pc, with one
+// vector operation for all of them. lanes that branched elsewhere, or
+// changed the instruction there, are masked out and wait until the group
+// gets to their pc.
+class BatchMachine
+{
+public:
+    static constexpr std::size_t WIDTH = 16;
+
+    // returns false if the image doesn't fit into memory
+    bool load(const std::vector<std::uint16_t>& image, std::vector<std::uint16_t> inputs,
+              std::vector<std::uint16_t> outputs);
+
+    // values holds one row of inputs per lane, so its size decides how
+    //  many lanes there are (a partial row at the end is ignored). groups
+    //  are spread over thread_count threads, 0 means one per core
+    BatchResult run(const std::vector<std::uint16_t>& values, std::uint64_t max_steps,
+                    std::size_t thread_count = 1) const;
+
+private:
+    // runs the lanes [first_lane, last_lane), a group at a time
+    void run_lanes(const std::vector<std::uint16_t>& values, std::size_t first_lane, std::size_t last_lane,
+                   std::uint64_t max_steps, BatchResult& result) const;
+
+    std::vector<std::uint16_t> m_image;
+    std::vector<std::uint16_t> m_inputs;
+    std::vector<std::uint16_t> m_outputs;
+};
+
+#endif // BATCH_H
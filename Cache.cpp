@@ -0,0 +1,321 @@
+#include "Cache.h"
+
+#include <algorithm>    // std::sort
+#include <atomic>       // std::atomic
+#include <chrono>       // std::chrono::hours
+#include <cstdio>       // FILE, fopen, ...
+#include <cstring>      // std::memcpy, std::memcmp
+#include <filesystem>   // std::filesystem
+#include <fstream>      // std::ifstream
+#include <sstream>      // std::ostringstream
+#include <thread>       // std::this_thread
+#include <vector>       // std::vector
+#include <fcntl.h>      // open
+#include <sys/file.h>   // flock
+#include <sys/stat.h>   // utimensat
+#include <unistd.h>     // getpid, close
+
+#include "debug.h"
+
+static constexpr char          ENTRY_MAGIC[4] = { 'M', 'U', '0', 'C' };
+static constexpr std::uint32_t ENTRY_FORMAT   = 5;
+static constexpr char          ENTRY_SUFFIX[] = ".mu0c";
+
+struct EntryHeader {
+    char          magic[4];
+    std::uint32_t format;
+    std::uint64_t source_size;
+    std::uint32_t image_words;
+    std::uint32_t listing_bytes;
+    std::uint32_t data_count;
+    std::uint32_t note_count;
+    std::uint32_t debug_bytes;
+};
+
+// followed by the name, without a terminator
+struct EntryData {
+    std::uint32_t name_size;
+    std::uint32_t address;
+    std::uint16_t value;
+    // keeps the written bytes free of padding
+    std::uint16_t unused;
+};
+
+// followed by the message, without a terminator
+struct EntryNote {
+    std::uint32_t line;
+    std::uint32_t column;
+    std::uint32_t message_size;
+};
+
+static std::uint64_t hash_bytes(std::string_view data, std::uint64_t seed);
+
+// which build of the assembler this is. the version alone stays the same
+//  across builds that assemble differently, so the running executable is
+//  hashed too. without it, only the time this file was compiled tells
+//  builds apart
+static const std::string& build_key() {
+    static const std::string key = [] {
+        std::string   text = assembler_version();
+        std::ifstream exe("/proc/self/exe", std::ios::binary);
+        if (!exe) {
+            return text + " " + __DATE__ + " " + __TIME__;
+        }
+        std::ostringstream contents;
+        contents << exe.rdbuf();
+        return text + " " + std::to_string(hash_bytes(contents.str(), 3));
+    }();
+    return key;
+}
+
+// everything besides the source that changes what the assembler produces
+static std::string config_key(const AssemblyOptions& options) {
+    return build_key() + (options.optimize ? " -O" : "")
+        + (options.dead_code == DeadCodeMode::Report ? " --dead" : "")
+        + (options.dead_code == DeadCodeMode::Remove ? " --strip-dead" : "")
+        + (options.relocate_data ? " --move-data" : "")
+        + (options.merge_constants ? " --merge-constants" : "")
+        + (options.superopt_length > 0 ? " --superopt " + std::to_string(options.superopt_length) : "")
+        + (options.inline_size > 0 ? " --inline " + std::to_string(options.inline_size) : "")
+        + (options.calls == CallConvention::Stack ? " --call-stack" : "")
+        + (options.annotate_listing ? " --blocks" : "");
+}
+
+// 64 bit multiply-xorshift hash, 8 bytes at a time. two of these with
+//  different seeds make up the 128 bit key of an entry
+static std::uint64_t hash_bytes(std::string_view data, std::uint64_t seed) {
+    constexpr std::uint64_t k = 0x9e3779b97f4a7c15ull;
+    std::uint64_t           h = seed ^ (data.size() * k);
+    auto mix = [&](std::uint64_t v) {
+        v *= 0xbf58476d1ce4e5b9ull;
+        v ^= v >> 31;
+        h ^= v;
+        h *= k;
+        h ^= h >> 29;
+    };
+    std::size_t i = 0;
+    for (; i + 8 <= data.size(); i += 8) {
+        std::uint64_t v;
+        std::memcpy(&v, data.data() + i, 8);
+        mix(v);
+    }
+    std::uint64_t tail = 0;
+    std::memcpy(&tail, data.data() + i, data.size() - i);
+    mix(tail);
+    h ^= h >> 32;
+    h *= 0x94d049bb133111ebull;
+    h ^= h >> 29;
+    return h;
+}
+
+AssemblyCache::AssemblyCache(std::string directory, std::uint64_t max_bytes)
+    : m_directory(std::move(directory))
+    , m_max_bytes(max_bytes) {
+    std::error_code ec;
+    std::filesystem::create_directories(m_directory, ec);
+}
+
+std::string AssemblyCache::entry_path(std::string_view source, const AssemblyOptions& options) const {
+    const std::string config = config_key(options);
+    std::uint64_t     lo     = hash_bytes(source, hash_bytes(config, 1));
+    std::uint64_t     hi     = hash_bytes(source, hash_bytes(config, 2));
+
+    static constexpr char hex_digits[] = "0123456789abcdef";
+    std::string           name(32, '0');
+    for (int i = 0; i < 16; ++i) {
+        name[static_cast<std::size_t>(15 - i)] = hex_digits[(hi >> (i * 4)) & 0xf];
+        name[static_cast<std::size_t>(31 - i)] = hex_digits[(lo >> (i * 4)) & 0xf];
+    }
+    return (std::filesystem::path(m_directory) / (name + ENTRY_SUFFIX)).string();
+}
+
+bool AssemblyCache::lookup(std::string_view source, const AssemblyOptions& options, AssemblyResult& result) {
+    const std::string path = entry_path(source, options);
+    FILE*             fp   = fopen(path.c_str(), "rb");
+    if (!fp) {
+        ++m_misses;
+        return false;
+    }
+    // anything that doesn't look exactly right is treated as a miss,
+    //  the entry then simply gets overwritten
+    EntryHeader header;
+    bool        ok = fread(&header, sizeof(header), 1, fp) == 1
+        && std::memcmp(header.magic, ENTRY_MAGIC, sizeof(ENTRY_MAGIC)) == 0
+        && header.format == ENTRY_FORMAT
+        && header.source_size == source.size();
+    AssemblyResult entry;
+    if (ok) {
+        entry.image.resize(header.image_words);
+        entry.listing.resize(header.listing_bytes);
+        ok = fread(entry.image.data(), sizeof(std::uint16_t), entry.image.size(), fp) == entry.image.size()
+            && fread(entry.listing.data(), 1, entry.listing.size(), fp) == entry.listing.size();
+        for (std::uint32_t i = 0; ok && i < header.data_count; ++i) {
+            EntryData data;
+            ok = fread(&data, sizeof(data), 1, fp) == 1;
+            if (ok) {
+                std::string name(data.name_size, '\0');
+                ok = fread(name.data(), 1, name.size(), fp) == name.size();
+                entry.data.push_back(DataSymbol { std::move(name), data.address, data.value });
+            }
+        }
+        for (std::uint32_t i = 0; ok && i < header.note_count; ++i) {
+            EntryNote note;
+            ok = fread(&note, sizeof(note), 1, fp) == 1;
+            if (ok) {
+                std::string message(note.message_size, '\0');
+                ok = fread(message.data(), 1, message.size(), fp) == message.size();
+                entry.notes.push_back(Diagnostic { source_location_t { note.line, note.column }, std::move(message) });
+            }
+        }
+        // the debug info as DebugInfo::to_text writes it
+        std::string debug(header.debug_bytes, '\0');
+        ok = ok && fread(debug.data(), 1, debug.size(), fp) == debug.size() && entry.debug_info.from_text(debug);
+        ok = ok && fgetc(fp) == EOF;
+    }
+    fclose(fp);
+    if (!ok) {
+        ++m_misses;
+        return false;
+    }
+    // mark as recently used for eviction
+    utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+    result = std::move(entry);
+    ++m_hits;
+    return true;
+}
+
+void AssemblyCache::store(std::string_view source, const AssemblyOptions& options, const AssemblyResult& result) {
+    if (!result.ok()) {
+        return;
+    }
+    const std::string path = entry_path(source, options);
+
+    // unique per process and thread, so concurrent writers never share a temporary
+    static std::atomic<std::uint64_t> counter = 0;
+    const std::string                 tmp_path = path + ".tmp-" + std::to_string(getpid()) + "-"
+        + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + "-"
+        + std::to_string(counter++);
+
+    FILE* fp = fopen(tmp_path.c_str(), "wb");
+    if (!fp) {
+        error("could not write cache entry '" << tmp_path << "'");
+        return;
+    }
+    EntryHeader header;
+    std::memcpy(header.magic, ENTRY_MAGIC, sizeof(ENTRY_MAGIC));
+    header.format        = ENTRY_FORMAT;
+    header.source_size   = source.size();
+    header.image_words   = static_cast<std::uint32_t>(result.image.size());
+    header.listing_bytes = static_cast<std::uint32_t>(result.listing.size());
+    header.data_count    = static_cast<std::uint32_t>(result.data.size());
+    header.note_count    = static_cast<std::uint32_t>(result.notes.size());
+    const std::string debug = result.debug_info.to_text();
+    header.debug_bytes   = static_cast<std::uint32_t>(debug.size());
+    bool ok              = fwrite(&header, sizeof(header), 1, fp) == 1
+        && fwrite(result.image.data(), sizeof(std::uint16_t), result.image.size(), fp) == result.image.size()
+        && fwrite(result.listing.data(), 1, result.listing.size(), fp) == result.listing.size();
+    std::size_t data_bytes = 0;
+    for (const DataSymbol& symbol : result.data) {
+        EntryData data { static_cast<std::uint32_t>(symbol.name.size()), symbol.address, symbol.value, 0 };
+        ok = ok && fwrite(&data, sizeof(data), 1, fp) == 1
+            && fwrite(symbol.name.data(), 1, symbol.name.size(), fp) == symbol.name.size();
+        data_bytes += sizeof(data) + symbol.name.size();
+    }
+    for (const Diagnostic& diagnostic : result.notes) {
+        EntryNote note { diagnostic.loc.line, diagnostic.loc.column, static_cast<std::uint32_t>(diagnostic.message.size()) };
+        ok = ok && fwrite(&note, sizeof(note), 1, fp) == 1
+            && fwrite(diagnostic.message.data(), 1, diagnostic.message.size(), fp) == diagnostic.message.size();
+        data_bytes += sizeof(note) + diagnostic.message.size();
+    }
+    ok = ok && fwrite(debug.data(), 1, debug.size(), fp) == debug.size();
+    data_bytes += debug.size();
+    ok = fclose(fp) == 0 && ok;
+    // rename is atomic, readers see either the old entry or the complete new one
+    if (!ok || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        return;
+    }
+    m_approx_bytes += sizeof(header) + result.image.size() * sizeof(std::uint16_t) + result.listing.size() + data_bytes;
+    if (!m_scanned || m_approx_bytes > m_max_bytes) {
+        evict();
+    }
+}
+
+AssemblyResult AssemblyCache::assemble(std::string_view source, const AssemblyOptions& options) {
+    // what a superopt database holds changes the result, and it changes
+    //  with every search, so these are never cached
+    if (options.superopt_length > 0 && options.superopt_database) {
+        return ::assemble(source, options);
+    }
+    AssemblyOptions with_listing = options;
+    with_listing.listing         = true;
+    with_listing.debug_info      = true;
+    AssemblyResult result;
+    if (lookup(source, with_listing, result)) {
+        return result;
+    }
+    result = ::assemble(source, with_listing);
+    store(source, with_listing, result);
+    return result;
+}
+
+void AssemblyCache::evict() {
+    const std::string lock_path = (std::filesystem::path(m_directory) / ".lock").string();
+    int               lock_fd   = open(lock_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (lock_fd < 0) {
+        return;
+    }
+    // if someone else is evicting already, they'll take care of it
+    if (flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+        close(lock_fd);
+        return;
+    }
+
+    struct Entry {
+        std::filesystem::file_time_type time;
+        std::uint64_t                   size;
+        std::filesystem::path           path;
+    };
+    std::vector<Entry> entries;
+    std::uint64_t      total = 0;
+    std::error_code    ec;
+    for (const auto& dir_entry : std::filesystem::directory_iterator(m_directory, ec)) {
+        const auto& path = dir_entry.path();
+        // entries can disappear under us, other processes don't need the lock to read
+        std::error_code entry_ec;
+        auto            size = dir_entry.file_size(entry_ec);
+        auto            time = dir_entry.last_write_time(entry_ec);
+        if (entry_ec) {
+            continue;
+        }
+        if (path.extension() != ENTRY_SUFFIX) {
+            // temporaries left behind by a writer that died before renaming them
+            if (path.filename().string().find(".tmp-") != std::string::npos
+                && std::filesystem::file_time_type::clock::now() - time > std::chrono::hours(1)) {
+                std::filesystem::remove(path, entry_ec);
+            }
+            continue;
+        }
+        entries.push_back(Entry { time, size, path });
+        total += size;
+    }
+
+    if (total > m_max_bytes) {
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+            return a.time < b.time;
+        });
+        // evict down to 90% so not every store has to evict again
+        const std::uint64_t target = m_max_bytes - m_max_bytes / 10;
+        for (const Entry& entry : entries) {
+            if (total <= target) {
+                break;
+            }
+            std::filesystem::remove(entry.path, ec);
+            total -= entry.size;
+        }
+    }
+    m_approx_bytes = total;
+    m_scanned      = true;
+    flock(lock_fd, LOCK_UN);
+    close(lock_fd);
+}
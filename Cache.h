@@ -0,0 +1,53 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <atomic>      // std::atomic
+#include <cstdint>     // std::uint...
+#include <string>      // std::string
+#include <string_view> // std::string_view
+#include "Assembler.h"
+
+// on-disk cache of assembled programs, keyed by a hash of the source and
+// the build of the assembler (and the options that change the output). a
+// hit skips parsing entirely. programs superoptimized with a database are
+// never cached, as the database changes what they assemble to.
+//
+// entries are written to a temporary file and renamed into place, so
+// readers never see a partial entry, and eviction holds an flock on the
+// cache directory, so several mu0asm processes can share one cache.
+class AssemblyCache
+{
+public:
+    AssemblyCache(std::string directory, std::uint64_t max_bytes);
+
+    // looks the source up, and assembles and stores it on a miss. only
+    //  results without errors are cached. the listing and the debug info
+    //  are always generated.
+    AssemblyResult assemble(std::string_view source, const AssemblyOptions& options);
+
+    bool lookup(std::string_view source, const AssemblyOptions& options, AssemblyResult& result);
+    void store(std::string_view source, const AssemblyOptions& options, const AssemblyResult& result);
+
+    std::uint64_t hits() const {
+        return m_hits;
+    }
+    std::uint64_t misses() const {
+        return m_misses;
+    }
+
+private:
+    std::string entry_path(std::string_view source, const AssemblyOptions& options) const;
+    // deletes the least recently used entries until the cache fits max_bytes
+    void evict();
+
+    std::string                m_directory;
+    std::uint64_t              m_max_bytes;
+    std::atomic<std::uint64_t> m_hits   = 0;
+    std::atomic<std::uint64_t> m_misses = 0;
+    // size of the cache as of the last eviction plus what we stored since,
+    //  so the directory only has to be scanned when it may be full
+    std::atomic<std::uint64_t> m_approx_bytes = 0;
+    std::atomic<bool>          m_scanned      = false;
+};
+
+#endif // CACHE_H
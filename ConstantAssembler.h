@@ -0,0 +1,326 @@
+#ifndef CONSTANTASSEMBLER_H
+#define CONSTANTASSEMBLER_H
+
+#include <algorithm>   // std::copy_n
+#include <array>       // std::array
+#include <cstddef>     // std::size_t
+#include <cstdint>     // std::uint...
+#include <string_view> // std::string_view
+#include "arch.h"
+
+// assembles a program while compiling, for embedding it into C++ code:
+//
+//     constexpr auto image = assemble_constant<"lda $a\nadd $a\nstp\nd a = 21\n">();
+//
+// the image is a std::array<std::uint16_t, N> of the words the assembler
+// writes into a.out with CallConvention::Inline. the syntax is the same,
+// except that numbers have to be valid through to their last digit and fit
+// into their word. any error fails compilation, with its message in the
+// diagnostic, and so does a program longer than the 4096 words of memory.
+// header-only, nothing of the assembler has to be linked.
+
+// the source as a template argument, made from a string literal
+template <std::size_t N>
+struct ConstantSource {
+    char text[N] {};
+
+    consteval ConstantSource(const char (&source)[N]) {
+        std::copy_n(source, N, text);
+    }
+
+    constexpr std::string_view view() const {
+        return std::string_view(text, N - 1);
+    }
+};
+
+namespace constant_assembly {
+constexpr std::size_t MEMORY_WORDS = 4096;
+
+// not constexpr, so calling it while assembling at compile time stops
+//  compilation. the call, and so the message, is part of the diagnostic
+inline void assembly_error(const char* message) {
+    static_cast<void>(message);
+}
+
+// one line of the source, split up like Lexer and Parser::parse_source do
+struct Statement {
+    Instr            instr = Instr::INVALID;
+    std::string_view head;
+    // everything after the instruction, from its first to its last token
+    std::string_view arg;
+};
+
+constexpr bool is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+constexpr std::string_view trim(std::string_view s) {
+    while (!s.empty() && (is_blank(s.front()) || s.front() == '\n')) {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && (is_blank(s.back()) || s.back() == '\n')) {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+// a statement for line, false for empty lines and lines with just a comment
+constexpr bool parse_statement(std::string_view line, Statement& statement) {
+    line = line.substr(0, line.find('#'));
+    // tokens are runs of anything but blanks and '=', or a single '='
+    std::size_t pos       = 0;
+    std::size_t token     = 0;
+    std::size_t words     = 0;
+    std::size_t arg_begin = std::string_view::npos, arg_end = 0;
+    while (true) {
+        while (pos < line.size() && is_blank(line[pos])) {
+            ++pos;
+        }
+        if (pos == line.size()) {
+            break;
+        }
+        const std::size_t start = pos;
+        if (line[pos] == '=') {
+            ++pos;
+        } else {
+            while (pos < line.size() && !is_blank(line[pos]) && line[pos] != '=') {
+                ++pos;
+            }
+        }
+        if (token++ == 0) {
+            statement.head = line.substr(start, pos - start);
+            continue;
+        }
+        if (arg_begin == std::string_view::npos) {
+            arg_begin = start;
+        }
+        arg_end = pos;
+        words += line[start] != '=' ? std::size_t { 1 } : 0;
+    }
+    if (token == 0) {
+        return false;
+    }
+    statement.arg = arg_begin == std::string_view::npos ? std::string_view() : line.substr(arg_begin, arg_end - arg_begin);
+    if (statement.head == "=") {
+        assembly_error("unexpected '='");
+    }
+    statement.instr = instr_from_name(statement.head);
+    if (statement.instr == Instr::INVALID) {
+        assembly_error("unknown instruction");
+    } else if (statement.instr == Instr::LABEL) {
+        if (!statement.arg.empty()) {
+            assembly_error("unexpected argument after label declaration");
+        }
+        if (!statement.head.ends_with(':')) {
+            assembly_error("label declaration expects ':' at the end");
+        }
+    } else if (instr_expects_arg(statement.instr)) {
+        if (statement.arg.empty()) {
+            assembly_error("argument expected");
+        }
+        if (statement.instr != Instr::DATA && words > 1) {
+            assembly_error("expected a single argument");
+        }
+    } else if (!statement.arg.empty()) {
+        assembly_error("argument supplied to an instruction which does not expect one");
+    }
+    return true;
+}
+
+// calls f with every statement of source
+template <typename F>
+constexpr void for_each_statement(std::string_view source, F&& f) {
+    while (!source.empty()) {
+        const std::size_t end = source.find('\n');
+        Statement         statement;
+        if (parse_statement(source.substr(0, end), statement)) {
+            f(statement);
+        }
+        source.remove_prefix(end == std::string_view::npos ? source.size() : end + 1);
+    }
+}
+
+// words a statement takes in the image, a call is expanded like
+//  Parser::expand_call does
+constexpr std::size_t words_of(Instr instr) {
+    return instr == Instr::LABEL ? 0 : instr == Instr::CALL ? 7 : 1;
+}
+
+constexpr std::size_t count_words(std::string_view source) {
+    std::size_t words = 0;
+    for_each_statement(source, [&](const Statement& statement) {
+        words += words_of(statement.instr);
+    });
+    return words;
+}
+
+constexpr std::size_t count_lines(std::string_view source) {
+    std::size_t lines = 1;
+    for (char c : source) {
+        lines += c == '\n' ? std::size_t { 1 } : 0;
+    }
+    return lines;
+}
+
+// a hex number with '0x', or a decimal one. max is the largest value allowed
+constexpr std::uint16_t parse_number(std::string_view text, std::uint32_t max) {
+    unsigned base = 10;
+    if (text.starts_with("0x")) {
+        base = 16;
+        text.remove_prefix(2);
+    }
+    if (text.empty()) {
+        assembly_error("expected a number");
+    }
+    std::uint32_t value = 0;
+    for (char c : text) {
+        unsigned digit = base;
+        if (c >= '0' && c <= '9') {
+            digit = static_cast<unsigned>(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            digit = static_cast<unsigned>(c - 'a' + 10);
+        } else if (c >= 'A' && c <= 'F') {
+            digit = static_cast<unsigned>(c - 'A' + 10);
+        }
+        if (digit >= base) {
+            assembly_error("invalid digit in number");
+        }
+        value = value * base + digit;
+        if (value > max) {
+            assembly_error("number doesn't fit");
+        }
+    }
+    return static_cast<std::uint16_t>(value);
+}
+
+struct Symbol {
+    // without its prefix
+    std::string_view name;
+    bool             label   = false;
+    std::uint16_t    address = 0;
+    std::uint16_t    value   = 0;
+};
+
+// every line declares at most one symbol, so MaxSymbols is the line count
+template <std::size_t MaxSymbols>
+class Assembler
+{
+public:
+    constexpr void define(std::string_view name, bool label, std::uint16_t address, std::uint16_t value = 0) {
+        if (name.empty()) {
+            assembly_error("name cannot be empty");
+        }
+        if (find(name, label)) {
+            assembly_error(label ? "label is declared more than once" : "data is declared more than once");
+        }
+        m_symbols[m_count++] = Symbol { name, label, address, value };
+    }
+
+    constexpr const Symbol* find(std::string_view name, bool label) const {
+        for (std::size_t i = 0; i < m_count; ++i) {
+            if (m_symbols[i].label == label && m_symbols[i].name == name) {
+                return &m_symbols[i];
+            }
+        }
+        return nullptr;
+    }
+
+    // the S of an instruction, like Parser::parse_arg
+    constexpr std::uint16_t resolve(std::string_view arg) const {
+        if (arg.front() >= '0' && arg.front() <= '9') {
+            return parse_number(arg, 0xfff);
+        }
+        const bool label = arg.starts_with(Prefix::LABEL);
+        if (!label && !arg.starts_with(Prefix::VAR)) {
+            assembly_error("usage of a name requires prefix '$'");
+        }
+        const Symbol* symbol = find(arg.substr(1), label);
+        if (!symbol) {
+            assembly_error("name could not be resolved as data or label");
+        }
+        return symbol->address;
+    }
+
+    // defines every label and data of source, the first pass of the assembler
+    constexpr void define_all(std::string_view source) {
+        std::uint16_t address = 0;
+        for_each_statement(source, [&](const Statement& statement) {
+            if (statement.instr == Instr::LABEL) {
+                define(statement.head.substr(1, statement.head.size() - 2), true, address);
+            } else if (statement.instr == Instr::DATA) {
+                const std::size_t equals = statement.arg.find('=');
+                if (equals == std::string_view::npos) {
+                    assembly_error("invalid format for data, must be of format 'name=N'");
+                }
+                const std::string_view rhs = trim(statement.arg.substr(equals + 1));
+                if (rhs.empty()) {
+                    assembly_error("right hand side of data cannot be empty");
+                }
+                define(trim(statement.arg.substr(0, equals)), false, address, parse_number(rhs, 0xffff));
+            }
+            address = static_cast<std::uint16_t>(address + words_of(statement.instr));
+        });
+    }
+
+    // writes the words of every statement of source, the second pass
+    template <std::size_t Words>
+    constexpr void encode_all(std::string_view source, std::array<std::uint16_t, Words>& image) const {
+        std::size_t address = 0;
+        auto        emit    = [&](Instr instr, std::uint16_t s) {
+            image[address++] = word_from_instr(instruction_t { static_cast<unsigned>(s & 0xfff), static_cast<unsigned>(instr) });
+        };
+        for_each_statement(source, [&](const Statement& statement) {
+            switch (statement.instr) {
+            case Instr::LABEL:
+                break;
+            case Instr::DATA:
+                image[address] = find(trim(statement.arg.substr(0, statement.arg.find('='))), false)->value;
+                ++address;
+                break;
+            case Instr::CALL: {
+                // keep acc, store the jump back into SUBR_PC_LOC and jump,
+                //  with the jump back as data skipped over
+                const auto first = static_cast<std::uint16_t>(address);
+                emit(Instr::STO, 0xffe);
+                emit(Instr::JMP, static_cast<std::uint16_t>(first + 3));
+                image[address++] = word_from_instr(instruction_t { static_cast<unsigned>((first + 7) & 0xfff), Instr::JMP });
+                emit(Instr::LDA, static_cast<std::uint16_t>(first + 2));
+                emit(Instr::STO, 0xfff);
+                emit(Instr::LDA, 0xffe);
+                emit(Instr::JMP, resolve(statement.arg));
+                break;
+            }
+            case Instr::RET:
+                emit(Instr::JMP, 0xfff);
+                break;
+            case Instr::STP:
+                emit(Instr::STP, 0);
+                break;
+            default:
+                emit(statement.instr, resolve(statement.arg));
+                break;
+            }
+        });
+    }
+
+private:
+    std::array<Symbol, MaxSymbols> m_symbols {};
+    std::size_t                    m_count = 0;
+};
+}
+
+// a program longer than memory doesn't satisfy the constraint, like
+//  Parser::check_size reports it as an error
+template <ConstantSource Source>
+    requires(constant_assembly::count_words(Source.view()) <= constant_assembly::MEMORY_WORDS)
+consteval auto assemble_constant() {
+    constexpr std::string_view  source = Source.view();
+    constexpr std::size_t       words  = constant_assembly::count_words(source);
+    std::array<std::uint16_t, words> image {};
+    constant_assembly::Assembler<constant_assembly::count_lines(source)> assembler;
+    assembler.define_all(source);
+    assembler.encode_all(source, image);
+    return image;
+}
+
+#endif // CONSTANTASSEMBLER_H
@@ -0,0 +1,319 @@
+#include "ControlFlow.h"
+
+#include <algorithm> // std::min, std::max, std::sort, std::find, ...
+#include <utility>   // std::pair
+
+namespace {
+std::uint64_t add(std::uint64_t a, std::uint64_t b) {
+    return a > UNBOUNDED_CYCLES - b ? UNBOUNDED_CYCLES : a + b;
+}
+
+CycleRange shift(CycleRange range, std::uint64_t cycles) {
+    if (range.impossible()) {
+        return range;
+    }
+    return CycleRange { add(range.min, cycles), add(range.max, cycles) };
+}
+
+// either one
+CycleRange unite(CycleRange a, CycleRange b) {
+    return CycleRange { std::min(a.min, b.min), std::max(a.max, b.max) };
+}
+
+// a, then b
+CycleRange chain(CycleRange a, CycleRange b) {
+    if (a.impossible() || b.impossible()) {
+        return CycleRange {};
+    }
+    return CycleRange { add(a.min, b.min), add(a.max, b.max) };
+}
+
+// from the start of a block to a stp, and to a ret
+struct Paths {
+    CycleRange to_stop;
+    CycleRange to_return;
+};
+
+enum class Visit : std::uint8_t
+{
+    New,
+    Active,
+    Done,
+};
+
+class Analysis
+{
+public:
+    explicit Analysis(ControlFlow& flow)
+        : m_flow(flow)
+        , m_paths(flow.blocks.size())
+        , m_visits(flow.blocks.size(), Visit::New) { }
+
+    void run() {
+        find_dominators();
+        find_fewest();
+        find_loops();
+        // a ret outside of any subroutine goes wherever the last return
+        //  address points to
+        const Paths start = paths(0);
+        m_flow.run        = unite(start.to_stop, chain(start.to_return, CycleRange { 1, UNBOUNDED_CYCLES }));
+    }
+
+private:
+    // successors, and where a call goes
+    std::vector<std::size_t> edges(std::size_t block) const {
+        std::vector<std::size_t> result = m_flow.blocks[block].successors;
+        if (m_flow.blocks[block].call != NO_BLOCK) {
+            result.push_back(m_flow.blocks[block].call);
+        }
+        return result;
+    }
+
+    // the iterative algorithm of Cooper, Harvey and Kennedy, over the blocks
+    //  in reverse postorder
+    void find_dominators() {
+        const std::size_t        count = m_flow.blocks.size();
+        std::vector<std::size_t> order;
+        std::vector<bool>        seen(count, false);
+        std::vector<std::pair<std::size_t, std::size_t>> stack { { 0, 0 } };
+        seen[0] = true;
+        while (!stack.empty()) {
+            auto& [block, next]            = stack.back();
+            const std::vector<std::size_t> out = edges(block);
+            if (next < out.size()) {
+                const std::size_t to = out[next++];
+                if (!seen[to]) {
+                    seen[to] = true;
+                    stack.emplace_back(to, 0);
+                }
+            } else {
+                order.push_back(block);
+                stack.pop_back();
+            }
+        }
+        std::reverse(order.begin(), order.end());
+        m_rpo.assign(count, NO_BLOCK);
+        for (std::size_t i = 0; i < order.size(); ++i) {
+            m_rpo[order[i]] = i;
+        }
+        m_preds.assign(count, {});
+        for (std::size_t block : order) {
+            for (std::size_t to : edges(block)) {
+                m_preds[to].push_back(block);
+            }
+        }
+
+        m_idom.assign(count, NO_BLOCK);
+        m_idom[0]    = 0;
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (std::size_t i = 1; i < order.size(); ++i) {
+                const std::size_t block = order[i];
+                std::size_t       idom  = NO_BLOCK;
+                for (std::size_t pred : m_preds[block]) {
+                    if (m_idom[pred] == NO_BLOCK) {
+                        continue;
+                    }
+                    idom = idom == NO_BLOCK ? pred : intersect(pred, idom);
+                }
+                if (idom != m_idom[block]) {
+                    m_idom[block] = idom;
+                    changed       = true;
+                }
+            }
+        }
+    }
+
+    std::size_t intersect(std::size_t a, std::size_t b) const {
+        while (a != b) {
+            while (m_rpo[a] > m_rpo[b])
+                a = m_idom[a];
+            while (m_rpo[b] > m_rpo[a])
+                b = m_idom[b];
+        }
+        return a;
+    }
+
+    bool dominates(std::size_t a, std::size_t b) const {
+        if (m_idom[b] == NO_BLOCK) {
+            return false;
+        }
+        while (b != a && b != 0) {
+            b = m_idom[b];
+        }
+        return b == a;
+    }
+
+    // a natural loop is everything that gets to an edge back to a block
+    //  that dominates it, without going through that block
+    void find_loops() {
+        for (std::size_t block = 0; block < m_flow.blocks.size(); ++block) {
+            for (std::size_t to : edges(block)) {
+                if (!dominates(to, block)) {
+                    continue;
+                }
+                auto loop = std::find_if(m_flow.loops.begin(), m_flow.loops.end(), [&](const Loop& l) {
+                    return l.header == to;
+                });
+                if (loop == m_flow.loops.end()) {
+                    m_flow.loops.push_back(Loop { to, { to }, {}, false });
+                    loop = m_flow.loops.end() - 1;
+                }
+                std::vector<std::size_t> work { block };
+                while (!work.empty()) {
+                    const std::size_t b = work.back();
+                    work.pop_back();
+                    if (std::find(loop->blocks.begin(), loop->blocks.end(), b) != loop->blocks.end()) {
+                        continue;
+                    }
+                    loop->blocks.push_back(b);
+                    work.insert(work.end(), m_preds[b].begin(), m_preds[b].end());
+                }
+            }
+        }
+        for (Loop& loop : m_flow.loops) {
+            std::sort(loop.blocks.begin(), loop.blocks.end());
+            std::vector<CycleRange> memo(m_flow.blocks.size());
+            std::vector<Visit>      visits(m_flow.blocks.size(), Visit::New);
+            loop.iteration = iteration(loop, loop.header, memo, visits);
+        }
+        std::sort(m_flow.loops.begin(), m_flow.loops.end(), [&](const Loop& a, const Loop& b) {
+            return m_flow.blocks[a.header].address < m_flow.blocks[b.header].address;
+        });
+    }
+
+    // what running a block once costs, with the subroutine it calls
+    CycleRange cycles_of(std::size_t block) {
+        const BasicBlock& b = m_flow.blocks[block];
+        CycleRange        range { b.cycles, b.cycles };
+        if (b.call != NO_BLOCK) {
+            range = shift(chain(range, paths(b.call).to_return), b.return_cycles);
+        }
+        return range;
+    }
+
+    // from the start of block back to the header of loop. edges back to a
+    //  block that's still being followed belong to inner loops, which
+    //  are left out
+    CycleRange iteration(Loop& loop, std::size_t block, std::vector<CycleRange>& memo, std::vector<Visit>& visits) {
+        if (visits[block] == Visit::Done) {
+            return memo[block];
+        }
+        visits[block]   = Visit::Active;
+        CycleRange next = {};
+        for (std::size_t to : m_flow.blocks[block].successors) {
+            if (to == loop.header) {
+                next = unite(next, CycleRange { 0, 0 });
+            } else if (std::binary_search(loop.blocks.begin(), loop.blocks.end(), to)) {
+                if (visits[to] == Visit::Active) {
+                    loop.has_inner = true;
+                } else {
+                    next = unite(next, iteration(loop, to, memo, visits));
+                }
+            }
+        }
+        memo[block]   = chain(cycles_of(block), next);
+        visits[block] = Visit::Done;
+        return memo[block];
+    }
+
+    // a block's paths, from the paths of the blocks it goes to
+    template <typename PathsOf>
+    Paths step(std::size_t block, PathsOf&& paths_of) {
+        const BasicBlock& b   = m_flow.blocks[block];
+        const CycleRange  own = { b.cycles, b.cycles };
+        Paths             result;
+        switch (b.exit) {
+        case BlockExit::Stop:
+            result.to_stop = own;
+            break;
+        case BlockExit::Return:
+            result.to_return = own;
+            break;
+        case BlockExit::Unknown:
+            // whatever it goes to runs at least one more instruction
+            result.to_stop   = CycleRange { add(b.cycles, 1), UNBOUNDED_CYCLES };
+            result.to_return = result.to_stop;
+            break;
+        case BlockExit::Next:
+            break;
+        }
+        Paths next;
+        for (std::size_t to : b.successors) {
+            const Paths p  = paths_of(to);
+            next.to_stop   = unite(next.to_stop, p.to_stop);
+            next.to_return = unite(next.to_return, p.to_return);
+        }
+        if (b.call != NO_BLOCK) {
+            // the subroutine may stop instead of returning
+            const Paths      sub      = paths_of(b.call);
+            const CycleRange returned = shift(sub.to_return, b.return_cycles);
+            result.to_stop   = unite(result.to_stop, chain(own, unite(sub.to_stop, chain(returned, next.to_stop))));
+            result.to_return = unite(result.to_return, chain(own, chain(returned, next.to_return)));
+        } else {
+            result.to_stop   = unite(result.to_stop, shift(next.to_stop, b.cycles));
+            result.to_return = unite(result.to_return, shift(next.to_return, b.cycles));
+        }
+        return result;
+    }
+
+    // the fewest cycles, by going over the blocks until none of them gets
+    //  any fewer. the most cycles are left to paths
+    void find_fewest() {
+        m_fewest.assign(m_flow.blocks.size(), Paths {});
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (std::size_t block = m_flow.blocks.size(); block-- > 0;) {
+                const Paths p = step(block, [&](std::size_t to) { return m_fewest[to]; });
+                if (p.to_stop.min < m_fewest[block].to_stop.min || p.to_return.min < m_fewest[block].to_return.min) {
+                    m_fewest[block] = p;
+                    changed         = true;
+                }
+            }
+        }
+    }
+
+    // depth first, a block that's still being followed is part of a cycle,
+    //  so anything that can get somewhere through it can take any number
+    //  of cycles to get there
+    Paths paths(std::size_t block) {
+        if (m_visits[block] == Visit::Done) {
+            return m_paths[block];
+        }
+        auto around = [](CycleRange fewest) {
+            return fewest.impossible() ? fewest : CycleRange { fewest.min, UNBOUNDED_CYCLES };
+        };
+        if (m_visits[block] == Visit::Active) {
+            return Paths { around(m_fewest[block].to_stop), around(m_fewest[block].to_return) };
+        }
+        m_visits[block] = Visit::Active;
+        Paths result    = step(block, [&](std::size_t to) { return paths(to); });
+        // the fewest cycles of a path through a cycle are only right in
+        //  m_fewest
+        result.to_stop.min   = m_fewest[block].to_stop.min;
+        result.to_return.min = m_fewest[block].to_return.min;
+        m_paths[block]       = result;
+        m_visits[block]      = Visit::Done;
+        return result;
+    }
+
+    ControlFlow&                          m_flow;
+    std::vector<Paths>                    m_fewest;
+    std::vector<Paths>                    m_paths;
+    std::vector<Visit>                    m_visits;
+    std::vector<std::size_t>              m_rpo;
+    std::vector<std::size_t>              m_idom;
+    std::vector<std::vector<std::size_t>> m_preds;
+};
+}
+
+void analyze_control_flow(ControlFlow& flow) {
+    flow.loops.clear();
+    flow.run = {};
+    if (flow.blocks.empty()) {
+        return;
+    }
+    Analysis(flow).run();
+}
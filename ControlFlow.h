@@ -0,0 +1,81 @@
+#ifndef CONTROLFLOW_H
+#define CONTROLFLOW_H
+
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uint...
+#include <limits>  // std::numeric_limits
+#include <vector>  // std::vector
+
+static constexpr std::size_t   NO_BLOCK        = std::numeric_limits<std::size_t>::max();
+// a number of cycles with no upper bound
+static constexpr std::uint64_t UNBOUNDED_CYCLES = std::numeric_limits<std::uint64_t>::max();
+
+// the fewest and most cycles something can take. UNBOUNDED_CYCLES as max
+// means it may take any number, as min that it never gets there
+struct CycleRange {
+    std::uint64_t min = UNBOUNDED_CYCLES;
+    std::uint64_t max = 0;
+
+    // no path at all
+    bool impossible() const {
+        return min == UNBOUNDED_CYCLES && max == 0;
+    }
+    bool bounded() const {
+        return max != UNBOUNDED_CYCLES;
+    }
+};
+
+// how a block ends, besides going on to its successors
+enum class BlockExit : std::uint8_t
+{
+    // falls through or jumps to the successors
+    Next,
+    Stop,
+    // a `ret`
+    Return,
+    // jumps somewhere that isn't code of the program, or runs data
+    Unknown,
+};
+
+struct BasicBlock {
+    std::uint32_t address = 0;
+    std::uint32_t words   = 0;
+    // cycles to run it once. for a call, the cycles until the subroutine
+    //  starts
+    std::uint32_t cycles = 0;
+    // for a call, the cycles from the ret of the subroutine (besides the
+    //  ret itself) back to after the call
+    std::uint32_t return_cycles = 0;
+    BlockExit     exit = BlockExit::Next;
+    // blocks it can go on to. a call goes on to where its ret returns to
+    std::vector<std::size_t> successors;
+    // the block a call goes to, NO_BLOCK if it isn't a call
+    std::size_t call = NO_BLOCK;
+    // data words its last jump jumps over
+    std::uint32_t data_skipped = 0;
+};
+
+struct Loop {
+    std::size_t              header;
+    std::vector<std::size_t> blocks;
+    // from the start of the header back to it, inner loops only counted once
+    CycleRange iteration;
+    bool       has_inner = false;
+};
+
+// the basic blocks of a program and what can be said about its cycles
+// without running it. every instruction takes one cycle
+struct ControlFlow {
+    // the first block is where the program starts
+    std::vector<BasicBlock> blocks;
+    std::vector<Loop>       loops;
+    // from the start to a stp
+    CycleRange run;
+    // false if the blocks couldn't be found, for example before parse_all
+    bool valid = false;
+};
+
+// fills in loops and run from the blocks
+void analyze_control_flow(ControlFlow& flow);
+
+#endif // CONTROLFLOW_H
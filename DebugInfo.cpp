@@ -0,0 +1,116 @@
+#include "DebugInfo.h"
+
+#include <algorithm> // std::upper_bound, std::find, std::stable_sort
+#include <iterator>  // std::begin, std::end
+
+#include "utility.h"
+
+static constexpr const char* WORD_KIND_NAMES[] = { "code", "data", "call", "ret", "runtime" };
+static constexpr const char  HEADER[]          = "# mu0asm debug info, 'address line:column kind' per word, '.label address' per label\n";
+
+const char* name_from_word_kind(WordKind kind) {
+    return WORD_KIND_NAMES[static_cast<std::size_t>(kind)];
+}
+
+static std::string hex_address(std::size_t address) {
+    static constexpr char hex_digits[] = "0123456789abcdef";
+    std::string           text         = "0x0000";
+    for (std::size_t i = 0; i < 4; ++i) {
+        text[5 - i] = hex_digits[(address >> (i * 4)) & 0xf];
+    }
+    return text;
+}
+
+std::string DebugInfo::to_text() const {
+    std::string text = HEADER;
+    auto        label = labels.begin();
+    for (std::size_t address = 0; address <= words.size(); ++address) {
+        // labels go right before the word they point to
+        for (; label != labels.end() && label->address == address; ++label) {
+            text += '.' + label->name + ' ' + hex_address(address) + '\n';
+        }
+        if (address == words.size()) {
+            break;
+        }
+        const WordDebugInfo& word = words[address];
+        text += hex_address(address) + ' ' + std::to_string(word.loc.line) + ':' + std::to_string(word.loc.column) + ' '
+            + name_from_word_kind(word.kind) + '\n';
+    }
+    return text;
+}
+
+// a number of the file, false if field isn't one
+static bool parse_field(std::string_view field, std::uint32_t& value) {
+    int base = 10;
+    if (field.substr(0, 2) == "0x") {
+        field = field.substr(2);
+        base  = 16;
+    }
+    if (field.empty() || field.size() > 9) {
+        return false;
+    }
+    const std::string_view digits = base == 16 ? "0123456789abcdef" : "0123456789";
+    for (char c : field) {
+        if (digits.find(c) == std::string_view::npos) {
+            return false;
+        }
+    }
+    value = 0;
+    for (char c : field) {
+        value = value * static_cast<std::uint32_t>(base) + static_cast<std::uint32_t>(digits.find(c));
+    }
+    return true;
+}
+
+bool DebugInfo::from_text(std::string_view text) {
+    words.clear();
+    labels.clear();
+    while (!text.empty()) {
+        const std::size_t      end  = std::min(text.find('\n'), text.size());
+        const std::string_view line = trim_whitespace(text.substr(0, end));
+        text                        = end < text.size() ? text.substr(end + 1) : std::string_view {};
+        if (line.empty() || line.front() == '#') {
+            continue;
+        }
+        const std::size_t first_space = line.find(' ');
+        if (first_space == std::string_view::npos) {
+            return false;
+        }
+        std::uint32_t          address = 0;
+        const std::string_view rest    = trim_whitespace(line.substr(first_space + 1));
+        if (line.front() == '.') {
+            if (!parse_field(rest, address)) {
+                return false;
+            }
+            labels.push_back(DebugLabel { std::string(line.substr(1, first_space - 1)), address });
+            continue;
+        }
+        // words come in order, without gaps
+        const std::size_t colon = rest.find(':');
+        const std::size_t space = rest.find(' ');
+        std::uint32_t     source_line = 0, column = 0;
+        if (!parse_field(line.substr(0, first_space), address) || address != words.size() || colon == std::string_view::npos
+            || space == std::string_view::npos || colon > space || !parse_field(rest.substr(0, colon), source_line)
+            || !parse_field(rest.substr(colon + 1, space - colon - 1), column)) {
+            return false;
+        }
+        const std::string_view kind = trim_whitespace(rest.substr(space + 1));
+        const auto             it   = std::find(std::begin(WORD_KIND_NAMES), std::end(WORD_KIND_NAMES), kind);
+        if (it == std::end(WORD_KIND_NAMES)) {
+            return false;
+        }
+        words.push_back(WordDebugInfo { source_location_t { source_line, column },
+                                        static_cast<WordKind>(it - std::begin(WORD_KIND_NAMES)) });
+    }
+    std::stable_sort(labels.begin(), labels.end(), [](const DebugLabel& a, const DebugLabel& b) {
+        return a.address < b.address;
+    });
+    return true;
+}
+
+const DebugLabel* DebugInfo::label_before(std::uint32_t address) const {
+    auto it = std::upper_bound(labels.begin(), labels.end(), address, [](std::uint32_t a, const DebugLabel& label) {
+        return a < label.address;
+    });
+    return it == labels.begin() ? nullptr : &*(it - 1);
+}
@@ -0,0 +1,53 @@
+#ifndef DEBUGINFO_H
+#define DEBUGINFO_H
+
+#include <cstdint>     // std::uint...
+#include <string>      // std::string
+#include <string_view> // std::string_view
+#include <vector>      // std::vector
+#include "arch.h"
+
+// what a word of the image came from
+enum class WordKind : std::uint8_t
+{
+    Code,
+    Data,
+    // part of the expansion of a `call`
+    Call,
+    // a `ret`
+    Return,
+    // the routines and constants of CallConvention::Stack
+    Runtime,
+};
+
+struct WordDebugInfo {
+    // line 0 for words the assembler made up
+    source_location_t loc;
+    WordKind          kind;
+};
+
+struct DebugLabel {
+    std::string   name;
+    std::uint32_t address;
+};
+
+// maps every word of an assembled program back to the source, written
+// next to the image as '{name}.dbg'. the file has a line per word,
+// 'address line:column kind', and one per label, '.name address'
+struct DebugInfo {
+    // one per word of the image
+    std::vector<WordDebugInfo> words;
+    // sorted by address
+    std::vector<DebugLabel> labels;
+
+    std::string to_text() const;
+    // false if text isn't debug info
+    bool from_text(std::string_view text);
+
+    // the last label at or before address, nullptr if there is none
+    const DebugLabel* label_before(std::uint32_t address) const;
+};
+
+const char* name_from_word_kind(WordKind kind);
+
+#endif // DEBUGINFO_H
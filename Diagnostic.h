@@ -0,0 +1,14 @@
+#ifndef DIAGNOSTIC_H
+#define DIAGNOSTIC_H
+
+#include <string> // std::string
+#include "arch.h"
+
+// an error found while assembling. line 0 means it's about the source as
+// a whole (for example, a file that couldn't be read) rather than a line.
+struct Diagnostic {
+    source_location_t loc;
+    std::string       message;
+};
+
+#endif // DIAGNOSTIC_H
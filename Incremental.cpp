@@ -0,0 +1,214 @@
+#include "Incremental.h"
+
+#include <algorithm> // std::count, std::partition_point, std::lower_bound
+#include <utility>   // std::move
+#include <vector>    // std::vector
+
+#include "debug.h"
+
+// rebuild once this much garbage piled up, on top of one per instruction
+static constexpr std::size_t GARBAGE_ALLOWANCE = 4096;
+
+static std::uint32_t count_lines(std::string_view text) {
+    auto lines = static_cast<std::uint32_t>(std::count(text.begin(), text.end(), '\n'));
+    // the last line may not end in a newline
+    if (!text.empty() && text.back() != '\n')
+        ++lines;
+    return lines;
+}
+
+IncrementalParser::IncrementalParser(std::string source)
+    : Parser(SourceBuffer()) {
+    rebuild(std::move(source));
+}
+
+IncrementalParser::UpdateStats IncrementalParser::rebuild(std::string source) {
+    m_invalid = false;
+    m_diagnostics.clear();
+    m_loc = source_location_t { 0, 0 };
+    m_symbols.clear();
+    m_program.clear();
+    m_instrs.clear();
+    m_arg_symbols.clear();
+    m_call_sites.clear();
+    m_garbage = 0;
+
+    SourceBuffer buffer;
+    buffer.assign(std::move(source));
+    m_source = std::move(buffer);
+    parse_source(m_source.view());
+    if (!m_invalid) {
+        parse_all();
+    }
+    UpdateStats stats;
+    stats.full           = true;
+    stats.lines_parsed   = count_lines(m_source.view());
+    stats.instrs_encoded = m_instrs.size();
+    return stats;
+}
+
+IncrementalParser::UpdateStats IncrementalParser::update(std::string source) {
+    if (m_invalid || m_garbage > GARBAGE_ALLOWANCE + m_program.size()) {
+        return rebuild(std::move(source));
+    }
+    UpdateStats stats;
+
+    const std::string_view before = m_source.view();
+    const std::string_view after  = source;
+    if (before == after) {
+        return stats;
+    }
+    const std::size_t limit = std::min(before.size(), after.size());
+
+    // whole lines that are the same at the start...
+    std::size_t   prefix_bytes = 0;
+    std::uint32_t prefix_lines = 0;
+    for (std::size_t i = 0; i < limit && before[i] == after[i]; ++i) {
+        if (before[i] == '\n') {
+            prefix_bytes = i + 1;
+            ++prefix_lines;
+        }
+    }
+    // ...and at the end, without overlapping the ones at the start
+    const std::size_t rest         = limit - prefix_bytes;
+    std::size_t       suffix_bytes = 0;
+    std::size_t       same         = 0;
+    for (; same < rest && before[before.size() - 1 - same] == after[after.size() - 1 - same]; ++same) {
+        if (before[before.size() - 1 - same] == '\n')
+            suffix_bytes = same;
+    }
+    if (same == rest) {
+        auto starts_line = [&](std::string_view text) {
+            std::size_t pos = text.size() - same;
+            return pos == prefix_bytes || text[pos - 1] == '\n';
+        };
+        if (starts_line(before) && starts_line(after))
+            suffix_bytes = same;
+    }
+
+    const std::string_view old_middle = before.substr(prefix_bytes, before.size() - suffix_bytes - prefix_bytes);
+    const std::size_t      new_middle_size = after.size() - suffix_bytes - prefix_bytes;
+    const auto             old_newlines = std::count(old_middle.begin(), old_middle.end(), '\n');
+    const auto             new_newlines = std::count(after.begin() + static_cast<std::ptrdiff_t>(prefix_bytes),
+                    after.begin() + static_cast<std::ptrdiff_t>(prefix_bytes + new_middle_size), '\n');
+    // first line after the change, in the old source
+    const auto old_suffix_line = static_cast<std::uint32_t>(prefix_lines + 1 + old_newlines);
+    const auto line_delta      = static_cast<std::uint32_t>(new_newlines - old_newlines);
+    auto       changed         = [&](std::uint32_t line) {
+        return line > prefix_lines && (suffix_bytes == 0 || line < old_suffix_line);
+    };
+    auto in_suffix = [&](std::uint32_t line) {
+        return suffix_bytes != 0 && line >= old_suffix_line;
+    };
+    log("changed lines " << prefix_lines + 1 << " to " << old_suffix_line - 1);
+
+    // rows are in source order, so the changed ones are [first, last)
+    const auto&       locs  = m_program.locs();
+    const std::size_t first = static_cast<std::size_t>(std::partition_point(locs.begin(), locs.end(), [&](const source_location_t& loc) {
+        return loc.line <= prefix_lines;
+    }) - locs.begin());
+    const std::size_t last  = static_cast<std::size_t>(std::partition_point(locs.begin() + static_cast<std::ptrdiff_t>(first), locs.end(), [&](const source_location_t& loc) {
+        return !in_suffix(loc.line);
+    }) - locs.begin());
+
+    // symbols declared on the changed lines go away, the ones after them
+    //  move down (or up) by the lines the change added
+    std::vector<symbol_id_t> suffix_symbols;
+    for (symbol_id_t id = 0; id < m_symbols.size(); ++id) {
+        Symbol& sym = m_symbols[id];
+        if (sym.removed) {
+            continue;
+        }
+        if (changed(sym.line)) {
+            m_symbols.remove(id);
+            ++m_garbage;
+        } else if (in_suffix(sym.line)) {
+            sym.line += line_delta;
+            suffix_symbols.push_back(id);
+        }
+    }
+
+    // the rows after the change stay, and the changed lines are lexed again
+    //  in between. the texts of the arguments are the program's own, so
+    //  none of them point into the old source once the new one replaces it
+    m_program.erase(first, last);
+    m_program.shift_lines(first, m_program.size(), line_delta);
+    const std::size_t        suffix_size = m_program.size() - first;
+    auto                     sites_end   = std::lower_bound(m_call_sites.begin(), m_call_sites.end(), last);
+    std::vector<std::size_t> suffix_sites(sites_end, m_call_sites.end());
+    m_call_sites.erase(std::lower_bound(m_call_sites.begin(), m_call_sites.end(), first), m_call_sites.end());
+    {
+        SourceBuffer buffer;
+        buffer.assign(std::move(source));
+        m_source = std::move(buffer);
+    }
+
+    const std::string_view middle = m_source.view().substr(prefix_bytes, new_middle_size);
+    parse_source(middle, prefix_lines + 1, static_cast<std::uint32_t>(first));
+    stats.lines_parsed        = count_lines(middle);
+    const std::size_t mid_end = m_program.size() - suffix_size;
+    const auto        shift   = static_cast<std::uint32_t>(mid_end - last);
+    const bool        shifted = mid_end != last;
+
+    // everything after the change is at a different address now
+    std::vector<bool> moved(m_symbols.size(), false);
+    if (shifted) {
+        for (symbol_id_t id : suffix_symbols) {
+            m_symbols.set_address(id, static_cast<std::uint32_t>(m_symbols[id].address + shift));
+            moved[id] = true;
+        }
+    }
+    // the return addresses of calls after the change moved too. the old
+    //  ones are all removed first, as their names overlap the new ones
+    for (std::size_t& site : suffix_sites) {
+        site = static_cast<std::uint32_t>(site + shift);
+        if (shifted) {
+            m_symbols.remove(m_symbols.find_at(SymbolKind::Data, static_cast<std::uint32_t>(site + 2)));
+            ++m_garbage;
+        }
+    }
+    for (std::size_t site : suffix_sites) {
+        m_call_sites.push_back(site);
+        if (shifted) {
+            set_call_return(site);
+            m_garbage += 3;
+            define_data(site + 2, site + 3);
+        }
+    }
+
+    m_instrs.erase(m_instrs.begin() + static_cast<std::ptrdiff_t>(first), m_instrs.begin() + static_cast<std::ptrdiff_t>(last));
+    m_instrs.insert(m_instrs.begin() + static_cast<std::ptrdiff_t>(first), mid_end - first, instruction_t {});
+    m_arg_symbols.erase(m_arg_symbols.begin() + static_cast<std::ptrdiff_t>(first), m_arg_symbols.begin() + static_cast<std::ptrdiff_t>(last));
+    m_arg_symbols.insert(m_arg_symbols.begin() + static_cast<std::ptrdiff_t>(first), mid_end - first, INVALID_SYMBOL);
+
+    define_data(first, mid_end);
+    encode(first, mid_end);
+    stats.instrs_encoded = mid_end - first;
+    if (shifted) {
+        for (std::size_t site : suffix_sites) {
+            encode(site + 1, site + 4);
+            stats.instrs_encoded += 3;
+        }
+    }
+
+    // the only instructions left to fix are the ones referring to symbols that moved or went away
+    auto resolve_moved = [&](std::size_t from, std::size_t to) {
+        for (std::size_t i = from; i < to; ++i) {
+            const symbol_id_t ref = m_arg_symbols[i];
+            if (ref != INVALID_SYMBOL && ((ref < moved.size() && moved[ref]) || m_symbols[ref].removed)) {
+                encode(i, i + 1);
+                ++stats.refs_resolved;
+                ++stats.instrs_encoded;
+            }
+        }
+    };
+    resolve_moved(0, first);
+    resolve_moved(mid_end, m_program.size());
+    check_size();
+    // errors are reported the way parsing all of it reports them, which the
+    //  changed lines alone can't, e.g. which of two labels is the second one
+    if (m_invalid) {
+        return rebuild(std::string(m_source.view()));
+    }
+    return stats;
+}
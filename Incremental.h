@@ -0,0 +1,41 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <cstddef> // std::size_t
+#include <string>  // std::string
+#include "Parser.h"
+
+// keeps the parsed state of a source resident, so a changed version of it
+// is assembled again by only lexing the lines that changed.
+//
+// the lines before the first and after the last changed line are kept.
+// everything after the change moves by however many instructions the
+// change added or removed, which moves the symbols there and the return
+// addresses of calls there. only references to symbols that moved or went
+// away are resolved again.
+class IncrementalParser : public Parser
+{
+public:
+    struct UpdateStats {
+        // everything was parsed again, because one of the sources had
+        //  errors or too much garbage piled up
+        bool        full           = false;
+        std::size_t lines_parsed   = 0;
+        std::size_t instrs_encoded = 0;
+        std::size_t refs_resolved  = 0;
+    };
+
+    explicit IncrementalParser(std::string source);
+
+    // replaces the source with a new version of it
+    UpdateStats update(std::string source);
+
+private:
+    UpdateStats rebuild(std::string source);
+
+    // symbols removed and generated arguments replaced since the last
+    //  rebuild, neither of which is ever freed until then
+    std::size_t m_garbage = 0;
+};
+
+#endif // INCREMENTAL_H
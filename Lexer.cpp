@@ -0,0 +1,144 @@
+#include "Lexer.h"
+
+#include <fstream>    // std::ifstream
+#include <iterator>   // std::istreambuf_iterator
+#include <utility>    // std::move, std::exchange
+#include <fcntl.h>    // open
+#include <sys/mman.h> // mmap, munmap, madvise
+#include <sys/stat.h> // fstat
+#include <unistd.h>   // close
+
+SourceBuffer::~SourceBuffer() {
+    release();
+}
+
+SourceBuffer::SourceBuffer(SourceBuffer&& other) noexcept {
+    *this = std::move(other);
+}
+
+SourceBuffer& SourceBuffer::operator=(SourceBuffer&& other) noexcept {
+    if (this == &other)
+        return *this;
+    release();
+    m_mapping      = std::exchange(other.m_mapping, nullptr);
+    m_mapping_size = std::exchange(other.m_mapping_size, 0);
+    if (other.m_view.data() == other.m_owned.data()) {
+        // the view has to follow the string, since short strings
+        //  live inside the string object itself
+        m_owned = std::move(other.m_owned);
+        m_view  = m_owned;
+    } else {
+        m_view = other.m_view;
+    }
+    other.m_view = {};
+    return *this;
+}
+
+void SourceBuffer::release() {
+    if (m_mapping) {
+        munmap(m_mapping, m_mapping_size);
+        m_mapping      = nullptr;
+        m_mapping_size = 0;
+    }
+    m_owned.clear();
+    m_view = {};
+}
+
+bool SourceBuffer::map_file(const std::string& filename) {
+    release();
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    auto size = static_cast<std::size_t>(st.st_size);
+    if (size == 0 || !S_ISREG(st.st_mode)) {
+        // empty files can't be mapped and pipes etc. can't be mapped either,
+        //  so those are read the slow way
+        close(fd);
+        std::ifstream file(filename, std::ios::in | std::ios::binary);
+        if (!file.is_open()) {
+            return false;
+        }
+        assign(std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()));
+        return true;
+    }
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping stays valid after closing the descriptor
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    // we read the source front to back exactly once
+    madvise(mapping, size, MADV_SEQUENTIAL);
+    m_mapping      = mapping;
+    m_mapping_size = size;
+    m_view         = std::string_view(static_cast<const char*>(mapping), size);
+    return true;
+}
+
+void SourceBuffer::assign(std::string source) {
+    release();
+    m_owned = std::move(source);
+    m_view  = m_owned;
+}
+
+void SourceBuffer::wrap(std::string_view source) {
+    release();
+    m_view = source;
+}
+
+Lexer::Lexer(std::string_view source, std::uint32_t first_line)
+    : m_source(source)
+    , m_line(first_line) {
+}
+
+static constexpr bool is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+Token Lexer::next() {
+    // skip blanks and comments, but not the newline that ends them
+    while (m_pos < m_source.size()) {
+        char c = m_source[m_pos];
+        if (is_blank(c)) {
+            ++m_pos;
+        } else if (c == '#') {
+            while (m_pos < m_source.size() && m_source[m_pos] != '\n') {
+                ++m_pos;
+            }
+        } else {
+            break;
+        }
+    }
+
+    source_location_t loc { m_line, static_cast<std::uint32_t>(m_pos - m_line_start + 1) };
+    if (m_pos >= m_source.size()) {
+        return Token { TokenKind::EndOfFile, {}, loc };
+    }
+
+    std::size_t start = m_pos;
+    char        c     = m_source[m_pos];
+    if (c == '\n') {
+        ++m_pos;
+        ++m_line;
+        m_line_start = m_pos;
+        return Token { TokenKind::EndOfLine, m_source.substr(start, 1), loc };
+    }
+    if (c == '=') {
+        ++m_pos;
+        return Token { TokenKind::Equals, m_source.substr(start, 1), loc };
+    }
+    while (m_pos < m_source.size()) {
+        c = m_source[m_pos];
+        if (is_blank(c) || c == '\n' || c == '=' || c == '#') {
+            break;
+        }
+        ++m_pos;
+    }
+    return Token { TokenKind::Word, m_source.substr(start, m_pos - start), loc };
+}
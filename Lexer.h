@@ -0,0 +1,77 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <cstddef>     // std::size_t
+#include <cstdint>     // std::uint...
+#include <string>      // std::string
+#include <string_view> // std::string_view
+#include "arch.h"
+
+// holds the bytes of a source file for as long as tokens point into it.
+// files are memory-mapped where possible, so lexing them never copies
+// the source. sources that don't come from a file are owned as a string.
+class SourceBuffer
+{
+public:
+    SourceBuffer() = default;
+    ~SourceBuffer();
+
+    SourceBuffer(const SourceBuffer&) = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+    SourceBuffer(SourceBuffer&& other) noexcept;
+    SourceBuffer& operator=(SourceBuffer&& other) noexcept;
+
+    // maps the file into memory, returns false if it could not be opened
+    bool map_file(const std::string& filename);
+    // takes ownership of an in-memory source
+    void assign(std::string source);
+    // refers to memory owned by the caller, which has to outlive the buffer
+    void wrap(std::string_view source);
+
+    std::string_view view() const {
+        return m_view;
+    }
+
+private:
+    void release();
+
+    std::string_view m_view;
+    // set if m_view points into a mapping, which then has to be unmapped
+    void*       m_mapping      = nullptr;
+    std::size_t m_mapping_size = 0;
+    std::string m_owned;
+};
+
+enum class TokenKind
+{
+    // any run of characters that is not whitespace, '=' or a comment
+    Word,
+    Equals,
+    EndOfLine,
+    EndOfFile,
+};
+
+struct Token {
+    TokenKind         kind;
+    std::string_view  text;
+    source_location_t loc;
+};
+
+// splits a source into tokens without allocating. all token texts are views
+// into the source, so the source has to outlive the tokens.
+class Lexer
+{
+public:
+    // first_line is the line the source starts at, for lexing part of a file
+    explicit Lexer(std::string_view source, std::uint32_t first_line = 1);
+
+    Token next();
+
+private:
+    std::string_view m_source;
+    std::size_t      m_pos        = 0;
+    std::uint32_t    m_line       = 1;
+    std::size_t      m_line_start = 0;
+};
+
+#endif // LEXER_H
@@ -0,0 +1,167 @@
+#include "Machine.h"
+
+#include <chrono> // std::chrono
+
+#include "arch.h"
+
+// dispatching through a table of label addresses (a GNU extension) gives
+//  every instruction its own indirect jump, which predicts a lot better
+//  than the one shared jump of a switch
+#if defined(__GNUC__)
+#define MACHINE_COMPUTED_GOTO 1
+#else
+#define MACHINE_COMPUTED_GOTO 0
+#endif
+
+Machine::Machine() {
+    load({});
+}
+
+bool Machine::load(const std::vector<std::uint16_t>& image) {
+    if (image.size() > MEMORY_WORDS) {
+        return false;
+    }
+    m_memory.fill(0);
+    for (std::size_t i = 0; i < image.size(); ++i) {
+        m_memory[i] = image[i];
+    }
+    for (std::size_t i = 0; i < MEMORY_WORDS; ++i) {
+        m_decoded[i] = decode(m_memory[i]);
+    }
+    m_acc = 0;
+    m_pc  = 0;
+    return true;
+}
+
+void Machine::write(std::uint16_t address, std::uint16_t word) {
+    address %= MEMORY_WORDS;
+    m_memory[address]  = word;
+    m_decoded[address] = decode(word);
+}
+
+#if MACHINE_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+RunResult Machine::run(std::uint64_t max_steps) {
+    return execute<false>(max_steps, nullptr);
+}
+
+RunResult Machine::run(std::uint64_t max_steps, Profile& profile) {
+    profile.executed.resize(MEMORY_WORDS);
+    profile.taken.resize(MEMORY_WORDS);
+    return execute<true>(max_steps, &profile);
+}
+
+template <bool Profiled>
+RunResult Machine::execute(std::uint64_t max_steps, Profile* profile) {
+    RunResult     result;
+    auto          start = std::chrono::steady_clock::now();
+    std::uint16_t acc   = m_acc;
+    // address of the next instruction
+    std::uint16_t pc    = m_pc;
+    std::uint64_t steps = 0;
+    Decoded       instr {};
+
+#define FETCH()                                                 \
+    if (steps == max_steps)                                     \
+        goto step_limit;                                        \
+    instr = m_decoded[pc];                                      \
+    if constexpr (Profiled)                                     \
+        ++profile->executed[pc];                                \
+    pc = static_cast<std::uint16_t>((pc + 1) % MEMORY_WORDS);   \
+    ++steps
+
+// counts the jump that was just fetched as taken
+#define TAKEN()                                                 \
+    if constexpr (Profiled)                                     \
+        ++profile->taken[(pc + MEMORY_WORDS - 1) % MEMORY_WORDS]
+
+#if MACHINE_COMPUTED_GOTO
+    static const void* const targets[16] = {
+        &&op_LDA, &&op_STO, &&op_ADD, &&op_SUB, &&op_JMP, &&op_JGE, &&op_JNE, &&op_STP,
+        &&op_invalid, &&op_invalid, &&op_invalid, &&op_invalid,
+        &&op_invalid, &&op_invalid, &&op_invalid, &&op_invalid
+    };
+#define DISPATCH() \
+    FETCH();       \
+    goto* targets[instr.opcode]
+#define HANDLER(op) op_##op
+#define INVALID_HANDLER op_invalid
+
+    DISPATCH();
+#else
+#define DISPATCH() goto dispatch
+#define HANDLER(op) case op
+#define INVALID_HANDLER default
+
+dispatch:
+    FETCH();
+    switch (instr.opcode) {
+#endif
+    HANDLER(LDA):
+        acc = m_memory[instr.operand];
+        DISPATCH();
+    HANDLER(STO):
+        // the stored word may be executed later, so it's decoded right away
+        m_memory[instr.operand]  = acc;
+        m_decoded[instr.operand] = decode(acc);
+        DISPATCH();
+    HANDLER(ADD):
+        acc = static_cast<std::uint16_t>(acc + m_memory[instr.operand]);
+        DISPATCH();
+    HANDLER(SUB):
+        acc = static_cast<std::uint16_t>(acc - m_memory[instr.operand]);
+        DISPATCH();
+    HANDLER(JMP):
+        TAKEN();
+        pc = instr.operand;
+        DISPATCH();
+    HANDLER(JGE):
+        if (static_cast<std::int16_t>(acc) >= 0) {
+            TAKEN();
+            pc = instr.operand;
+        }
+        DISPATCH();
+    HANDLER(JNE):
+        if (acc != 0) {
+            TAKEN();
+            pc = instr.operand;
+        }
+        DISPATCH();
+    HANDLER(STP):
+        result.reason = StopReason::Stopped;
+        goto halt;
+    INVALID_HANDLER:
+        result.reason = StopReason::InvalidOpcode;
+        goto halt;
+#if !MACHINE_COMPUTED_GOTO
+    }
+#endif
+
+#undef FETCH
+#undef TAKEN
+#undef DISPATCH
+#undef HANDLER
+#undef INVALID_HANDLER
+
+halt:
+    // a stopped machine stays on the instruction it stopped at
+    pc = static_cast<std::uint16_t>((pc + MEMORY_WORDS - 1) % MEMORY_WORDS);
+    goto done;
+step_limit:
+    result.reason = StopReason::StepLimit;
+done:
+    m_acc          = acc;
+    m_pc           = pc;
+    result.acc     = acc;
+    result.pc      = pc;
+    result.steps   = steps;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+#if MACHINE_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
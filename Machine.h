@@ -0,0 +1,93 @@
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include <array>   // std::array
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uint...
+#include <vector>  // std::vector
+
+enum class StopReason
+{
+    // ran into a STP
+    Stopped,
+    // ran into an opcode MU0 doesn't have
+    InvalidOpcode,
+    // ran for the maximum number of instructions without stopping
+    StepLimit,
+};
+
+struct RunResult {
+    StopReason    reason = StopReason::Stopped;
+    std::uint16_t acc    = 0;
+    // address of the stp or invalid instruction the machine stopped at, or
+    //  with StepLimit the address of the next instruction it would run
+    std::uint16_t pc    = 0;
+    std::uint64_t steps = 0;
+    double        seconds = 0;
+
+    double instructions_per_second() const {
+        return seconds > 0 ? static_cast<double>(steps) / seconds : 0;
+    }
+};
+
+// what Machine::run counted for every address, see profile_report
+struct Profile {
+    // how often the instruction at each address ran, which is also how
+    //  many cycles it took
+    std::vector<std::uint64_t> executed;
+    // how often the jump at each address jumped
+    std::vector<std::uint64_t> taken;
+};
+
+// runs assembled MU0 programs. every word of memory is kept decoded next
+// to its raw value, so executing an instruction never has to decode it.
+// code and data share the memory, so every store decodes the stored word
+// again, which keeps self-modifying code (and executed `d` data) working.
+class Machine
+{
+public:
+    static constexpr std::size_t MEMORY_WORDS = 4096;
+
+    Machine();
+
+    // clears the memory and the registers and puts image at address 0.
+    //  returns false if the image doesn't fit into memory
+    bool load(const std::vector<std::uint16_t>& image);
+    // runs from the current pc until a STP or until max_steps instructions ran
+    RunResult run(std::uint64_t max_steps);
+    // the same, counting what ran in profile. counts add up over runs
+    RunResult run(std::uint64_t max_steps, Profile& profile);
+
+    std::uint16_t acc() const {
+        return m_acc;
+    }
+    std::uint16_t pc() const {
+        return m_pc;
+    }
+    std::uint16_t read(std::uint16_t address) const {
+        return m_memory[address % MEMORY_WORDS];
+    }
+    // writes like a STO does
+    void write(std::uint16_t address, std::uint16_t word);
+
+private:
+    // profiling is a template argument, so run doesn't pay for it
+    template <bool Profiled>
+    RunResult execute(std::uint64_t max_steps, Profile* profile);
+
+    struct Decoded {
+        std::uint8_t  opcode;
+        std::uint16_t operand;
+    };
+
+    static constexpr Decoded decode(std::uint16_t word) {
+        return Decoded { static_cast<std::uint8_t>(word >> 12), static_cast<std::uint16_t>(word & 0xfff) };
+    }
+
+    std::array<std::uint16_t, MEMORY_WORDS> m_memory;
+    std::array<Decoded, MEMORY_WORDS>       m_decoded;
+    std::uint16_t                           m_acc = 0;
+    std::uint16_t                           m_pc  = 0;
+};
+
+#endif // MACHINE_H
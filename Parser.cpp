@@ -1,217 +1,1658 @@
 #include "Parser.h"
 
-#include <fstream>   // std::ifstream, std::ofstream
+#include <cstdio>    // fopen, fwrite
 #include <iostream>  // std::cout, std::cerr
 #include <algorithm> // std::find..., std::erase
 #include <iomanip>   // std::setw, std::setfill, etc.
 #include <cassert>   // assert
+#include <map>       // std::map
+#include <set>       // std::set
+#include <thread>    // std::thread
 
+#include "Assembler.h"
+#include "Stats.h"
+#include "ThreadPool.h"
 #include "debug.h"
 #include "utility.h"
 
-Parser::Parser(const std::string& filename) {
-    std::ifstream file(filename, std::ios::in);
-    if (!file.is_open()) {
-        error("file '" << filename << "' not found");
-        m_invalid = true;
+// records an error at the location currently being parsed, see add_diagnostic
+#define report_error(x)                       \
+    do {                                      \
+        std::ostringstream report_stream;     \
+        report_stream << x;                   \
+        add_diagnostic(report_stream.str());  \
+    } while (false)
+
+// records an error of a part of the source in chunk, see Parser::ParsedChunk
+#define report_chunk_error(loc, x)                                                                \
+    do {                                                                                          \
+        std::ostringstream report_stream;                                                         \
+        report_stream << x;                                                                       \
+        chunk.events.push_back(ParsedChunk::Event { {}, 0, loc, report_stream.str() });           \
+    } while (false)
+
+// sources are split into parts of at least this many bytes to parse them
+//  in parallel, and rows into runs of at least this many to encode them
+static constexpr std::size_t PARALLEL_PARSE_BYTES = 256 * 1024;
+static constexpr std::size_t PARALLEL_ENCODE_ROWS = 16 * 1024;
+static constexpr std::size_t MEMORY_WORDS         = 4096;
+
+Parser::Parser(const std::string& filename, CallConvention calls, std::size_t thread_count)
+    : m_calls(calls)
+    , m_thread_count(thread_count) {
+    if (!m_source.map_file(filename)) {
+        report_error("file '" << filename << "' not found");
         return;
     }
-    std::size_t   line_nr  = 1;
-    std::uint16_t instr_nr = 0;
-
-    do {
-        // FIXME: This entire loop needs cleaning up
-        std::string s;
-        std::getline(file, s);
-        // trim comments
-        s.erase(std::find(s.begin(), s.end(), '#'), s.end());
-        s = trim_whitespace(s);
-        // ignore now-empty lines
-        if (s.empty()) {
-            ++line_nr;
-            continue;
+    parse_source(m_source.view());
+}
+
+Parser::Parser(SourceBuffer source, CallConvention calls, std::size_t thread_count)
+    : m_source(std::move(source))
+    , m_calls(calls)
+    , m_thread_count(thread_count) {
+    parse_source(m_source.view());
+}
+
+void Parser::add_diagnostic(std::string message) {
+    m_diagnostics.push_back(Diagnostic { m_loc, std::move(message) });
+    m_invalid = true;
+}
+
+std::size_t Parser::worker_count() const {
+    if (m_thread_count != 0) {
+        return m_thread_count;
+    }
+    return std::max<std::size_t>(1, std::thread::hardware_concurrency());
+}
+
+void Parser::parse_source(std::string_view source, std::uint32_t first_line, std::uint32_t first_instr) {
+    PhaseTimer timer(StatPhase::Parse);
+    assert(first_instr <= m_program.size());
+    const std::size_t chunk_count = std::min(worker_count(), source.size() / PARALLEL_PARSE_BYTES);
+    if (chunk_count > 1) {
+        parse_source_parallel(source, first_line, first_instr, chunk_count);
+        log("parsing done");
+        return;
+    }
+    if (stats_enabled()) {
+        add_stat(StatCounter::SourceLines, static_cast<std::uint64_t>(std::count(source.begin(), source.end(), '\n'))
+                     + (!source.empty() && source.back() != '\n' ? 1 : 0));
+    }
+    ParsedChunk chunk;
+    parse_chunk(source, first_line, chunk);
+    for (std::size_t site : chunk.call_sites) {
+        set_call_return(chunk.program, site, first_instr + site);
+    }
+    // a whole source is lexed into an empty program, which then is the chunk
+    if (m_program.empty()) {
+        m_program = std::move(chunk.program);
+    } else {
+        m_program.insert(first_instr, chunk.program);
+    }
+    add_chunk(chunk, first_instr, 0);
+    log("parsing done");
+}
+
+void Parser::parse_source_parallel(std::string_view source, std::uint32_t first_line, std::uint32_t first_instr, std::size_t chunk_count) {
+    // parts end after a '\n', so no statement is split up
+    std::vector<std::string_view> parts;
+    std::size_t                   begin = 0;
+    for (std::size_t i = 1; i < chunk_count && begin < source.size(); ++i) {
+        std::size_t end = source.find('\n', std::max(begin, source.size() / chunk_count * i));
+        if (end == std::string_view::npos) {
+            break;
         }
-        // split instr and arg
-        Instr instr = instr_from_name(std::string(std::begin(s), std::find(s.begin(), s.end(), ' ')));
-        if (instr == Instr::CALL) {
-            // calls into subroutines are implemented by holding the PC before the jump
-            // in a data segment so we can jump back to it
-
-            // save acc in subr_acc_loc since we need acc momentarily and don't want to lose data from it
-            ++instr_nr;
-            verbose("PC: " << instr_nr);
-            m_instr_arg_pairs.push_back(instr_arg_pair_t { STO, SUBR_ACC_LOC });
-
-            // now we store the current PC in hex at some location
-            // since there is no immediate value instruction we have to hack together
-            // a temporary variable with a DATA segment which we jump over so it
-            // doesn't get executed.
-
-            // so we add the jump to skip ahead to the second instruction after the jmp
-            // to skip the data segment that's coming up
-            ++instr_nr;
-            verbose("PC: " << instr_nr);
-            verbose("instr: JMP " << as_hex_string(instr_nr + 1));
-            m_instr_arg_pairs.push_back(instr_arg_pair_t { JMP, as_hex_string(instr_nr + 1) });
-
-            // now we add the data segment to hold the PC to jump back to
-            ++instr_nr;
-            verbose("PC: " << instr_nr);
-            // offset to jump back to
-            std::uint16_t offset = 4;
-            // we need to use a name here, so we use `__pc__ADDRESS`, where `ADDRESS` is the PC we stored
-            std::string pc_store_name = std::string("__pc__") + as_hex_string(instr_nr + offset);
-            // let's make an instruction (hacky & wacky)
-            instruction_t instr_to_insert;
-            instr_to_insert.opcode     = static_cast<std::uint8_t>(JMP);
-            instr_to_insert.S          = instr_nr + offset;
-            std::string pc_store_instr = pc_store_name + "=" + as_hex_string(reinterpret_cast<std::uint16_t&>(instr_to_insert));
-            verbose("instr: " << nameof(pc_store_instr) << ": '" << pc_store_instr << "'");
-            m_instr_arg_pairs.push_back(instr_arg_pair_t { DATA, pc_store_instr });
-
-            // load the pc we want to jump to later
-            ++instr_nr;
-            verbose("PC: " << instr_nr);
-            m_instr_arg_pairs.push_back(instr_arg_pair_t { LDA, std::string(Prefix::VAR) + pc_store_name });
-
-            // store it in the pc location
-            ++instr_nr;
-            verbose("PC: " << instr_nr);
-            m_instr_arg_pairs.push_back(instr_arg_pair_t { STO, SUBR_PC_LOC });
-
-            // retore acc
-            ++instr_nr;
-            verbose("PC: " << instr_nr);
-            m_instr_arg_pairs.push_back(instr_arg_pair_t { LDA, SUBR_ACC_LOC });
-
-            // extracting the argument for the call instruction
-            std::string arg;
-            if (!extract_arg(instr, s, line_nr, arg)) {
-                error("subroutine call argument is invalid (this is fatal)");
-                m_invalid = true;
+        parts.push_back(source.substr(begin, end + 1 - begin));
+        begin = end + 1;
+    }
+    parts.push_back(source.substr(begin));
+
+    std::vector<ParsedChunk> chunks(parts.size());
+    ThreadPool               pool(parts.size());
+    for (std::size_t i = 0; i < parts.size(); ++i) {
+        pool.submit([&, i] {
+            chunks[i].newlines = static_cast<std::uint32_t>(std::count(parts[i].begin(), parts[i].end(), '\n'));
+            parse_chunk(parts[i], 1, chunks[i]);
+        });
+    }
+    pool.wait();
+
+    // where every part starts, in rows and in lines
+    std::vector<std::size_t>   offsets(chunks.size());
+    std::vector<std::uint32_t> line_offsets(chunks.size());
+    std::size_t                rows  = first_instr;
+    std::uint32_t              lines = first_line - 1;
+    for (std::size_t i = 0; i < chunks.size(); ++i) {
+        offsets[i]      = rows;
+        line_offsets[i] = lines;
+        rows += chunks[i].program.size();
+        lines += chunks[i].newlines;
+    }
+    if (stats_enabled()) {
+        add_stat(StatCounter::SourceLines, lines - (first_line - 1) + (!source.empty() && source.back() != '\n' ? 1 : 0));
+    }
+
+    // every part is finished where it is, with its own texts
+    for (std::size_t i = 0; i < chunks.size(); ++i) {
+        pool.submit([&, i] {
+            ParsedChunk& chunk = chunks[i];
+            chunk.program.shift_lines(0, chunk.program.size(), line_offsets[i]);
+            for (std::size_t site : chunk.call_sites) {
+                set_call_return(chunk.program, site, offsets[i] + site);
             }
-            // add the original call instruction as jmp
-            ++instr_nr;
-            verbose("PC: " << instr_nr);
-            verbose("instr: jmp(call) " << arg);
-            m_instr_arg_pairs.push_back(instr_arg_pair_t { JMP, arg });
+        });
+    }
+    pool.wait();
+
+    // symbols and diagnostics in the order of the source, like parsing it
+    //  on a single thread
+    m_program.reserve(m_program.size() + rows - first_instr);
+    for (std::size_t i = 0; i < chunks.size(); ++i) {
+        m_program.insert(offsets[i], chunks[i].program);
+        add_chunk(chunks[i], offsets[i], line_offsets[i]);
+    }
+}
+
+void Parser::add_chunk(ParsedChunk& chunk, std::size_t offset, std::uint32_t line_offset) {
+    for (std::size_t site : chunk.call_sites) {
+        m_call_sites.push_back(offset + site);
+    }
+    for (const ParsedChunk::Event& event : chunk.events) {
+        m_loc = source_location_t { event.loc.line + line_offset, event.loc.column };
+        if (event.label.empty()) {
+            add_diagnostic(event.message);
+        } else {
+            parse_label(event.label, static_cast<std::uint32_t>(offset + event.index));
+        }
+    }
+    if (!chunk.empty) {
+        m_loc = source_location_t { chunk.last_loc.line + line_offset, chunk.last_loc.column };
+    }
+    m_uses_ret = m_uses_ret || chunk.uses_ret;
+}
+
+void Parser::parse_chunk(std::string_view source, std::uint32_t first_line, ParsedChunk& chunk) const {
+    Lexer lexer(source, first_line);
+
+    Token tok = lexer.next();
+    while (tok.kind != TokenKind::EndOfFile) {
+        // ignore empty lines (and lines which only had a comment)
+        if (tok.kind == TokenKind::EndOfLine) {
+            tok = lexer.next();
+            continue;
+        }
+        // a statement is the instruction followed by everything up to the end of the line.
+        //  the argument is the span from the first to the last token after the instruction,
+        //  which keeps 'name = N' of data together as one view into the source
+        Token       head       = tok;
+        chunk.empty            = false;
+        chunk.last_loc         = head.loc;
+        const char* arg_begin  = nullptr;
+        const char* arg_end    = nullptr;
+        std::size_t word_count = 0;
+        for (tok = lexer.next(); tok.kind != TokenKind::EndOfLine && tok.kind != TokenKind::EndOfFile; tok = lexer.next()) {
+            if (!arg_begin)
+                arg_begin = tok.text.data();
+            arg_end = tok.text.data() + tok.text.size();
+            if (tok.kind == TokenKind::Word)
+                ++word_count;
+        }
+        std::string_view arg;
+        if (arg_begin)
+            arg = std::string_view(arg_begin, static_cast<std::size_t>(arg_end - arg_begin));
+
+        if (head.kind != TokenKind::Word) {
+            report_chunk_error(head.loc, "unexpected '" << head.text << "'");
+            continue;
+        }
+        Instr instr = instr_from_name(head.text);
+        if (instr == Instr::INVALID) {
+            report_chunk_error(head.loc, "unknown instruction '" << head.text << "'");
             continue;
-        } else if (instr == Instr::RET) {
-            // only works if there was a call before and SUBR_PC_LOC is set
-            ++instr_nr;
-            verbose("PC: " << instr_nr);
-            m_instr_arg_pairs.push_back(instr_arg_pair_t { JMP, SUBR_PC_LOC });
         }
         if (instr == Instr::LABEL) {
-            parse_label(s, instr_nr);
-            ++line_nr;
+            if (!arg.empty()) {
+                report_chunk_error(head.loc, "unexpected '" << arg << "' after label declaration");
+                continue;
+            }
+            chunk.events.push_back(ParsedChunk::Event { head.text, chunk.program.size(), head.loc, {} });
             continue;
         }
-        instr_nr++;
-        verbose("PC: " << instr_nr);
-        std::string arg;
-        if (!extract_arg(instr, s, line_nr, arg))
+        if (instr_expects_arg(instr)) {
+            if (arg.empty()) {
+                report_chunk_error(head.loc, "argument expected for '" << head.text << "'");
+                continue;
+            }
+            // only data takes more than one word ('name = N')
+            if (instr != Instr::DATA && word_count > 1) {
+                report_chunk_error(head.loc, "expected a single argument for '"
+                                                 << head.text << "', got '" << arg << "'");
+                continue;
+            }
+        } else if (!arg.empty()) {
+            // ensure that there was no argument given to an instruction that does not expect one
+            report_chunk_error(head.loc, "argument '" << arg
+                                                      << "' supplied to '" << name_from_instr(instr)
+                                                      << "' which does not expect an argument");
             continue;
-        if (instr == Instr::INVALID) {
-            error("source line " << line_nr << ": parsed instruction is unknown / invalid");
-            m_invalid = true;
+        }
+
+        if (instr == Instr::CALL) {
+            expand_call(arg, head.loc, chunk);
+            continue;
+        } else if (instr == Instr::RET) {
+            // only works if there was a call before and SUBR_PC_LOC is set
+            verbose("PC: " << chunk.program.size() + 1);
+            chunk.uses_ret = true;
+            chunk.program.push_back(JMP, m_calls == CallConvention::Stack ? ".__ret" : SUBR_PC_LOC, head.loc);
             continue;
         }
-        instr_arg_pair_t pair { instr, arg };
-        log("source line " << line_nr << ": parsed instr of pair: " << name_from_instr(instr) << " " << arg);
-        m_instr_arg_pairs.push_back(pair);
-        ++line_nr;
-    } while (!file.eof());
-    log("parsing done");
+        verbose("PC: " << chunk.program.size() + 1);
+        log("source line " << head.loc.line << ": parsed instr: " << name_from_instr(instr) << " " << arg);
+        // "d" and "dx" are the only names of data
+        chunk.program.push_back(instr, arg, head.loc, instr == Instr::DATA && head.text.size() == 2);
+    }
+}
+
+void Parser::expand_call(std::string_view target, source_location_t loc, ParsedChunk& chunk) const {
+    // calls into subroutines are implemented by holding the PC before the jump
+    // in a data segment so we can jump back to it. the arguments that depend
+    // on where the call ends up are left empty, see set_call_return
+
+    Program& program = chunk.program;
+    chunk.call_sites.push_back(program.size());
+    add_stat(StatCounter::CallExpansions);
+
+    if (m_calls == CallConvention::Stack) {
+        // save acc, then have .__push push the return address and jump to
+        //  the target. both are jumps kept as constants after the program
+        program.push_back(STO, "$__acc", loc);
+        program.push_back(LDA, program.intern({ "$__jmp__", target }), loc);
+        program.push_back(STO, ".__call_jump", loc);
+        program.push_back(LDA, NO_ARG, loc);
+        program.push_back(JMP, ".__push", loc);
+        verbose("instr: call " << target << " through the return stack");
+        return;
+    }
+
+    // save acc in subr_acc_loc since we need acc momentarily and don't want to lose data from it
+    program.push_back(STO, SUBR_ACC_LOC, loc);
+
+    // now we store the current PC in hex at some location
+    // since there is no immediate value instruction we have to hack together
+    // a temporary variable with a DATA segment which we jump over so it
+    // doesn't get executed.
+
+    // so we add the jump to skip ahead to the second instruction after the jmp
+    // to skip the data segment that's coming up
+    program.push_back(JMP, NO_ARG, loc);
+
+    // now we add the data segment to hold the PC to jump back to
+    program.push_back(DATA, NO_ARG, loc);
+
+    // load the pc we want to jump to later
+    program.push_back(LDA, NO_ARG, loc);
+
+    // store it in the pc location
+    program.push_back(STO, SUBR_PC_LOC, loc);
+
+    // retore acc
+    program.push_back(LDA, SUBR_ACC_LOC, loc);
+
+    // add the original call instruction as jmp
+    verbose("instr: jmp(call) " << target);
+    program.push_back(JMP, target, loc);
 }
 
-void Parser::write_asm_to(const std::string& filename) {
-    std::ofstream file(filename, std::ios::trunc);
-    if (!file.is_open()) {
+void Parser::set_call_return(Program& program, std::size_t first, std::size_t address) const {
+    if (m_calls == CallConvention::Stack) {
+        // the constant is named after the address it returns to, like `__pc__` below
+        const auto return_address = static_cast<std::uint32_t>(address + call_size());
+        program.set_arg(first + 3, program.intern({ "$__ret__", as_hex_string(return_address) }));
+        return;
+    }
+    // the jump over the data segment, to the lda after it
+    verbose("instr: JMP " << as_hex_string(static_cast<std::uint32_t>(address + 3)));
+    program.set_arg(first + 1, as_hex_string(static_cast<std::uint32_t>(address + 3)));
+
+    // offset to jump back to, the instruction after the whole expansion
+    const auto return_address = static_cast<std::uint32_t>(address + 7);
+    // we need to use a name here, so we use `__pc__ADDRESS`, where `ADDRESS` is the PC we stored
+    const std::string pc = as_hex_string(return_address);
+    // let's make an instruction (hacky & wacky)
+    instruction_t instr_to_insert;
+    instr_to_insert.opcode = static_cast<std::uint8_t>(JMP);
+    instr_to_insert.S      = return_address & 0xfff;
+    const arg_id_t pc_store_instr = program.intern({ "__pc__", pc, "=", as_hex_string(word_from_instr(instr_to_insert)) });
+    verbose("instr: " << nameof(pc_store_instr) << ": '" << program.text(pc_store_instr) << "'");
+    program.set_arg(first + 2, pc_store_instr);
+    program.set_arg(first + 3, program.intern({ Prefix::VAR, "__pc__", pc }));
+}
+
+void Parser::write_asm_to(const std::string& filename, bool annotate) {
+    // reused between calls, so writing many listings doesn't allocate a buffer each time
+    thread_local std::string buffer;
+    if (annotate) {
+        const ControlFlow flow = control_flow();
+        write_listing(buffer, &flow);
+    } else {
+        write_listing(buffer);
+    }
+
+    FILE* fp = fopen(filename.c_str(), "wb");
+    if (!fp) {
         error("could not open file '" << filename << "'");
         return;
     }
+    fwrite(buffer.data(), 1, buffer.size(), fp);
+    fclose(fp);
+}
+
+static void append_labels_at(std::string& out, const SymbolTable& symbols, std::uint32_t address) {
+    for (symbol_id_t id = symbols.first_at(address); id != INVALID_SYMBOL; id = symbols[id].next_at_address) {
+        if (symbols[id].kind == SymbolKind::Label) {
+            out += Prefix::LABEL;
+            out += symbols[id].name;
+            out += ":\n";
+        }
+    }
+}
+
+static std::string address_string(std::size_t address) {
+    std::ostringstream ss;
+    ss << "0x" << std::hex << std::setw(4) << std::setfill('0') << address;
+    return ss.str();
+}
+
+static std::string cycles_string(CycleRange range) {
+    if (range.impossible()) {
+        return "never";
+    }
+    if (range.min == UNBOUNDED_CYCLES) {
+        return "unknown";
+    }
+    std::string text = std::to_string(range.min);
+    if (!range.bounded()) {
+        return "at least " + text + " cycles";
+    }
+    if (range.max != range.min) {
+        text += " to " + std::to_string(range.max);
+    }
+    return text + (range.max == 1 ? " cycle" : " cycles");
+}
+
+// what is known about the whole program, as comments at the top
+static void append_flow_summary(std::string& out, const ControlFlow& flow) {
+    out += "# " + std::to_string(flow.blocks.size()) + (flow.blocks.size() == 1 ? " basic block, " : " basic blocks, ");
+    out += std::to_string(flow.loops.size()) + (flow.loops.size() == 1 ? " loop\n" : " loops\n");
+    for (const Loop& loop : flow.loops) {
+        out += "# loop at " + address_string(flow.blocks[loop.header].address) + ": ";
+        out += std::to_string(loop.blocks.size()) + (loop.blocks.size() == 1 ? " block, " : " blocks, ");
+        out += cycles_string(loop.iteration) + " per iteration";
+        out += loop.has_inner ? ", inner loops counted once\n" : "\n";
+    }
+    out += "# from the start to stp: " + cycles_string(flow.run) + "\n";
+}
+
+// how much a block costs and where it goes, as a comment above it
+static void append_block(std::string& out, const ControlFlow& flow, const BasicBlock& block) {
+    out += "# block " + address_string(block.address) + ": ";
+    if (block.call != NO_BLOCK) {
+        out += "call of " + address_string(flow.blocks[block.call].address) + ", ";
+        out += std::to_string(block.cycles + block.return_cycles) + " cycles besides the subroutine";
+    } else {
+        out += std::to_string(block.words) + (block.words == 1 ? " instruction, " : " instructions, ");
+        out += std::to_string(block.cycles) + (block.cycles == 1 ? " cycle" : " cycles");
+    }
+    if (block.data_skipped != 0) {
+        out += ", jumps over " + std::to_string(block.data_skipped) + (block.data_skipped == 1 ? " data word" : " data words");
+    }
+    std::vector<std::string> exits;
+    for (std::size_t to : block.successors) {
+        exits.push_back(address_string(flow.blocks[to].address));
+    }
+    switch (block.exit) {
+    case BlockExit::Stop:
+        exits.push_back("stops");
+        break;
+    case BlockExit::Return:
+        exits.push_back("returns");
+        break;
+    case BlockExit::Unknown:
+        exits.push_back("goes somewhere unknown");
+        break;
+    case BlockExit::Next:
+        break;
+    }
+    for (std::size_t i = 0; i < exits.size(); ++i) {
+        out += i == 0 ? ", then " : " or ";
+        out += exits[i];
+    }
+    out += '\n';
+}
 
-    std::uint16_t instr_nr = 0;
-    for (instr_arg_pair_t& pair : m_instr_arg_pairs) {
-        std::stringstream ss;
-        ss << "    " << name_from_instr(pair.instr) << " ";
-        if (pair.arg == SUBR_ACC_LOC)
-            ss << "$SUBR_ACC_LOC";
-        else if (pair.arg == SUBR_PC_LOC)
-            ss << "$SUBR_PC_LOC";
+void Parser::write_listing(std::string& out, const ControlFlow* flow) const {
+    static constexpr char   hex_digits[] = "0123456789abcdef";
+    static constexpr size_t pc_column    = 40;
+
+    out.clear();
+    // roughly one line per instruction
+    out.reserve(m_program.size() * (pc_column + 8));
+    std::vector<std::size_t> block_at;
+    if (flow && flow->valid) {
+        append_flow_summary(out, *flow);
+        block_at.assign(m_program.size(), NO_BLOCK);
+        for (std::size_t b = 0; b < flow->blocks.size(); ++b) {
+            block_at[flow->blocks[b].address] = b;
+        }
+    }
+    std::uint32_t instr_nr = 0;
+    for (std::size_t i = 0; i < m_program.size(); ++i) {
+        if (!block_at.empty() && block_at[instr_nr] != NO_BLOCK) {
+            append_block(out, *flow, flow->blocks[block_at[instr_nr]]);
+        }
+        append_labels_at(out, m_symbols, instr_nr);
+        std::size_t line_start = out.size();
+        out += "    ";
+        const std::string_view arg = m_program.arg(i);
+        out += m_program.executed(i) ? "dx" : name_from_instr(m_program.instr(i));
+        out += ' ';
+        if (arg == SUBR_ACC_LOC)
+            out += "$SUBR_ACC_LOC";
+        else if (arg == SUBR_PC_LOC)
+            out += "$SUBR_PC_LOC";
         else
-            ss << pair.arg;
-        std::string line    = ss.str();
-        int         padding = static_cast<int>(40 - line.size());
-        file << line << std::setfill(' ') << std::setw(padding) << " # PC: 0x"
-             << std::setfill('0') << std::setw(4) << std::hex << instr_nr << std::endl;
+            out += arg;
+        // the comment starts at a fixed column, or right after the line if it's too long
+        std::size_t line_size = out.size() - line_start;
+        if (line_size + 9 < pc_column) {
+            out.append(pc_column - 9 - line_size, ' ');
+        }
+        out += " # PC: 0x";
+        out += hex_digits[(instr_nr >> 12) & 0xf];
+        out += hex_digits[(instr_nr >> 8) & 0xf];
+        out += hex_digits[(instr_nr >> 4) & 0xf];
+        out += hex_digits[instr_nr & 0xf];
+        out += '\n';
         ++instr_nr;
-        auto iter = std::find_if(m_label_map.begin(), m_label_map.end(),
-            [&](auto& l_pair) -> bool {
-                return l_pair.second == instr_nr;
-            });
-        if (iter != m_label_map.end()) {
-            file << iter->first << ":" << std::endl;
+    }
+    // labels at the very end of the program
+    append_labels_at(out, m_symbols, instr_nr);
+}
+
+static bool is_number(std::string_view arg) {
+    return !arg.empty() && std::isdigit(static_cast<unsigned char>(arg.front()));
+}
+
+static std::uint16_t number_value(std::string_view arg) {
+    return arg.substr(0, 2) == "0x" ? number_from_string(arg.substr(2), 16) : number_from_string(arg, 10);
+}
+
+static bool is_label(std::string_view arg) {
+    return arg.substr(0, std::strlen(Prefix::LABEL)) == Prefix::LABEL;
+}
+
+static bool is_jump(Instr instr) {
+    return instr == Instr::JMP || instr == Instr::JGE || instr == Instr::JNE;
+}
+
+std::vector<bool> Parser::call_rows() const {
+    std::vector<bool> in_call(m_program.size(), false);
+    for (std::size_t site : m_call_sites) {
+        std::fill(in_call.begin() + static_cast<std::ptrdiff_t>(site), in_call.begin() + static_cast<std::ptrdiff_t>(site + call_size()), true);
+    }
+    return in_call;
+}
+
+bool Parser::code_is_movable(const std::vector<bool>& in_call) const {
+    // addresses written as numbers, and code used as data, would point to
+    //  the wrong instruction once anything moves
+    for (std::size_t i = 0; i < m_program.size(); ++i) {
+        const Instr            instr = m_program.instr(i);
+        const std::string_view arg   = m_program.arg(i);
+        if (in_call[i] || instr == Instr::DATA) {
+            continue;
+        }
+        if (is_number(arg)) {
+            if (number_value(arg) <= m_program.size()) {
+                log("'" << arg << "' may refer to an instruction, not moving code");
+                return false;
+            }
+        } else if (is_label(arg) && !is_jump(instr)) {
+            log("'" << name_from_instr(instr) << " " << arg << "' uses code as data, not moving code");
+            return false;
+        }
+    }
+    // the rows of calls are skipped above, but what they call may be a
+    //  number too
+    for (std::size_t site : m_call_sites) {
+        const std::string_view target = call_target(site);
+        if (is_number(target) && number_value(target) <= m_program.size()) {
+            log("call of '" << target << "' may refer to an instruction, not moving code");
+            return false;
         }
     }
+    return true;
+}
+
+std::size_t Parser::label_address(std::string_view arg) const {
+    symbol_id_t id = m_symbols.find(SymbolKind::Label, arg.substr(std::strlen(Prefix::LABEL)));
+    return id == INVALID_SYMBOL ? m_program.size() + 1 : m_symbols[id].address;
 }
 
-bool Parser::extract_arg(Instr instr, const std::string& line, std::size_t line_nr, std::string& arg) {
-    if (instr_expects_arg(instr)) {
-        if (std::find(line.begin(), line.end(), ' ') == line.end()) {
-            error("source line " << line_nr << ": argument expected for '" << line << "'");
-            m_invalid = true;
+bool Parser::reachable_rows(std::vector<bool>& reachable) const {
+    // blocks start at the entry point, at labels and after every jump, so
+    //  following the jumps and falling through from 0 reaches every block
+    //  that can run
+    const Program&           program = m_program;
+    std::vector<std::size_t> work { 0 };
+    auto                     reach = [&](std::size_t i) {
+        if (i < program.size() && !reachable[i]) {
+            reachable[i] = true;
+            work.push_back(i);
+        }
+    };
+    reachable.assign(program.size(), false);
+    if (program.empty()) {
+        return true;
+    }
+    reachable[0] = true;
+    std::vector<bool> is_site(program.size(), false);
+    for (std::size_t site : m_call_sites) {
+        is_site[site] = true;
+    }
+    while (!work.empty()) {
+        const std::size_t i = work.back();
+        work.pop_back();
+        const Instr instr = program.instr(i);
+        if (is_site[i]) {
+            // ret goes back to after the call
+            std::fill(reachable.begin() + static_cast<std::ptrdiff_t>(i), reachable.begin() + static_cast<std::ptrdiff_t>(i + call_size()), true);
+            if (!is_label(call_target(i))) {
+                log("call of '" << call_target(i) << "' can't be followed");
+                return false;
+            }
+            reach(label_address(call_target(i)));
+            reach(i + call_size());
+            continue;
+        }
+        if (instr == Instr::DATA) {
+            // runs whatever the data is, which may jump anywhere
             return false;
         }
-        arg = line.substr(line.find_first_of(' ') + 1);
-    } else {
-        // ensure that there was no argument given to an instruction that does not expect one,
-        //  since this should never happen as this would mean that wrong assumptions were made
-        if (std::find(line.begin(), line.end(), ' ') != line.end()) { // if there is a space
-            auto trimmed = trim_whitespace(line.substr(line.find_first_of(' ')));
-            // if there are characters in the argument except whitespace (which has been trimmed)
-            if (!trimmed.empty()) {
-                error("source line " << line_nr << ": argument '" << trimmed
-                                     << "' supplied to '" << name_from_instr(instr)
-                                     << "' which does not expect an argument");
-                m_invalid = true;
+        // a ret goes back to after a call, which the call reached already
+        if (is_jump(instr) && !is_ret(i)) {
+            if (!is_label(program.arg(i))) {
+                // a number, or data that may be run, could be anywhere
+                log("'" << name_from_instr(instr) << " " << program.arg(i) << "' can't be followed");
                 return false;
             }
+            reach(label_address(program.arg(i)));
+        }
+        if (instr != Instr::JMP && instr != Instr::STP) {
+            reach(i + 1);
         }
     }
     return true;
 }
 
+DebugInfo Parser::debug_info() const {
+    DebugInfo               info;
+    const std::vector<bool> in_call = call_rows();
+    info.words.reserve(m_program.size());
+    for (std::size_t i = 0; i < m_program.size(); ++i) {
+        WordKind kind = m_program.instr(i) == Instr::DATA ? WordKind::Data : WordKind::Code;
+        if (in_call[i]) {
+            kind = WordKind::Call;
+        } else if (is_ret(i)) {
+            kind = WordKind::Return;
+        } else if (m_program.loc(i).line == 0) {
+            // only add_call_runtime adds rows without a line
+            kind = WordKind::Runtime;
+        }
+        info.words.push_back(WordDebugInfo { m_program.loc(i), kind });
+    }
+    for (const Symbol& symbol : m_symbols) {
+        if (symbol.kind == SymbolKind::Label && !symbol.removed) {
+            info.labels.push_back(DebugLabel { std::string(symbol.name), symbol.address });
+        }
+    }
+    std::stable_sort(info.labels.begin(), info.labels.end(), [](const DebugLabel& a, const DebugLabel& b) {
+        return a.address < b.address;
+    });
+    return info;
+}
+
+ControlFlow Parser::control_flow() const {
+    ControlFlow flow;
+    // only the instructions are needed, the targets of jumps are encoded already
+    const std::vector<Instr>& instrs = m_program.instrs();
+    if (m_invalid || instrs.empty() || m_instrs.size() != instrs.size() || instrs[0] == Instr::DATA) {
+        return flow;
+    }
+    std::vector<bool> is_site(instrs.size(), false);
+    for (std::size_t site : m_call_sites) {
+        is_site[site] = true;
+    }
+    auto called = [&](std::size_t site) {
+        const std::string_view target = call_target(site);
+        return is_label(target) ? label_address(target) : is_number(target) ? number_value(target) : instrs.size();
+    };
+
+    // blocks start at the entry point, at whatever a jump or call goes to,
+    //  and after every jump, call, ret and stp
+    std::vector<bool>        reachable(instrs.size(), false);
+    std::vector<bool>        leader(instrs.size() + 1, false);
+    std::vector<std::size_t> work { 0 };
+    auto                     reach = [&](std::size_t i, bool starts_block = true) {
+        if (i >= instrs.size()) {
+            return;
+        }
+        leader[i] = leader[i] || starts_block;
+        if (!reachable[i]) {
+            reachable[i] = true;
+            work.push_back(i);
+        }
+    };
+    reach(0);
+    while (!work.empty()) {
+        const std::size_t i = work.back();
+        work.pop_back();
+        const Instr instr = instrs[i];
+        if (is_site[i]) {
+            leader[i] = true;
+            reach(called(i));
+            reach(i + call_size());
+            continue;
+        }
+        if (instr == Instr::DATA) {
+            continue;
+        }
+        if (is_jump(instr) && !is_ret(i)) {
+            reach(m_instrs[i].S);
+        }
+        if (is_jump(instr) || instr == Instr::STP) {
+            leader[i + 1] = true;
+            if (instr == Instr::JGE || instr == Instr::JNE) {
+                reach(i + 1);
+            }
+            continue;
+        }
+        reach(i + 1, false);
+    }
+
+    std::vector<std::size_t> block_at(instrs.size(), NO_BLOCK);
+    for (std::size_t i = 0; i < instrs.size(); ++i) {
+        if (reachable[i] && leader[i] && (is_site[i] || instrs[i] != Instr::DATA)) {
+            block_at[i] = flow.blocks.size();
+            BasicBlock& block = flow.blocks.emplace_back();
+            block.address     = static_cast<std::uint32_t>(i);
+        }
+    }
+    // NO_BLOCK for anything that isn't code the program runs
+    auto block_of = [&](std::size_t i) {
+        return i < instrs.size() ? block_at[i] : NO_BLOCK;
+    };
+    for (BasicBlock& block : flow.blocks) {
+        std::size_t i = block.address;
+        if (is_site[i]) {
+            block.words = static_cast<std::uint32_t>(call_size());
+            // the inline call skips its data word, the stack call goes on
+            //  through .__push
+            block.cycles = static_cast<std::uint32_t>(m_calls == CallConvention::Stack
+                                                          ? call_size() + label_address(".__call_jump") + 1 - label_address(".__push")
+                                                          : call_size() - 1);
+            block.return_cycles = call_cost(m_calls).cycles - 1 - block.cycles;
+            block.call   = block_of(called(i));
+            if (block.call == NO_BLOCK || block_of(i + call_size()) == NO_BLOCK) {
+                block.exit = BlockExit::Unknown;
+            } else {
+                block.successors.push_back(block_of(i + call_size()));
+            }
+            continue;
+        }
+        for (;; ++i) {
+            if (i != block.address && (i >= instrs.size() || leader[i] || instrs[i] == Instr::DATA)) {
+                // falls into the next block, or into data
+                if (block_of(i) == NO_BLOCK) {
+                    block.exit = BlockExit::Unknown;
+                } else {
+                    block.successors.push_back(block_of(i));
+                }
+                break;
+            }
+            const Instr instr = instrs[i];
+            ++block.words;
+            if (is_ret(i)) {
+                block.exit = BlockExit::Return;
+                break;
+            }
+            if (instr == Instr::STP) {
+                block.exit = BlockExit::Stop;
+                break;
+            }
+            if (is_jump(instr)) {
+                const std::size_t target = m_instrs[i].S;
+                std::vector<std::size_t> next { block_of(target) };
+                if (instr != Instr::JMP) {
+                    next.push_back(block_of(i + 1));
+                } else if (target > i + 1 && target <= instrs.size()
+                           && std::all_of(instrs.begin() + static_cast<std::ptrdiff_t>(i + 1), instrs.begin() + static_cast<std::ptrdiff_t>(target),
+                                          [](Instr in) { return in == Instr::DATA; })) {
+                    block.data_skipped = static_cast<std::uint32_t>(target - i - 1);
+                }
+                for (std::size_t to : next) {
+                    if (to == NO_BLOCK) {
+                        block.exit = BlockExit::Unknown;
+                    } else if (std::find(block.successors.begin(), block.successors.end(), to) == block.successors.end()) {
+                        block.successors.push_back(to);
+                    }
+                }
+                break;
+            }
+        }
+        block.cycles = block.words;
+    }
+    analyze_control_flow(flow);
+    flow.valid = true;
+    return flow;
+}
+
+DeadCode Parser::find_dead_code() const {
+    DeadCode dead;
+    if (m_invalid || !m_instrs.empty()) {
+        return dead;
+    }
+    const Program&          program = m_program;
+    const std::vector<bool> in_call = call_rows();
+    std::vector<bool>       reachable;
+    // the jumps of code that computes or modifies addresses can't be followed
+    if (!code_is_movable(in_call) || !reachable_rows(reachable)) {
+        return dead;
+    }
+
+    // the data of a call goes with it
+    std::vector<bool> gone(program.size(), false);
+    for (std::size_t i = 0; i < program.size(); ++i) {
+        if (reachable[i] || (program.instr(i) == Instr::DATA && !in_call[i])) {
+            continue;
+        }
+        gone[i] = true;
+        if (i == 0 || !gone[i - 1]) {
+            dead.code.push_back({ i, i + 1 });
+        } else {
+            dead.code.back().second = i + 1;
+        }
+    }
+    // data is used if anything that stays names it
+    std::set<std::string_view> used;
+    for (std::size_t i = 0; i < program.size(); ++i) {
+        if (!gone[i] && program.instr(i) != Instr::DATA && program.arg(i).substr(0, std::strlen(Prefix::VAR)) == Prefix::VAR) {
+            used.insert(program.arg(i).substr(std::strlen(Prefix::VAR)));
+        }
+    }
+    for (std::size_t i = 0; i < program.size(); ++i) {
+        const std::string_view arg = program.arg(i);
+        if (program.instr(i) != Instr::DATA || in_call[i] || arg.find('=') == std::string_view::npos) {
+            continue;
+        }
+        if (used.count(trim_whitespace(arg.substr(0, arg.find('=')))) == 0) {
+            gone[i] = true;
+            dead.data.push_back(i);
+        }
+    }
+    // a jmp over nothing but dead code and data jumps to the next instruction once it's gone
+    for (std::size_t i = 0; i < program.size(); ++i) {
+        if (gone[i] || in_call[i] || program.instr(i) != Instr::JMP || !is_label(program.arg(i))) {
+            continue;
+        }
+        const std::size_t to = label_address(program.arg(i));
+        if (to > i + 1 && to <= program.size()
+            && std::all_of(gone.begin() + static_cast<std::ptrdiff_t>(i + 1), gone.begin() + static_cast<std::ptrdiff_t>(to), [](bool g) { return g; })) {
+            dead.jumps.push_back(i);
+        }
+    }
+    return dead;
+}
+
+std::size_t Parser::remove_dead_code(const DeadCode& dead) {
+    if (dead.code.empty() && dead.data.empty()) {
+        return 0;
+    }
+    std::vector<bool> in_call = call_rows();
+    std::vector<bool> remove(m_program.size(), false);
+    for (const auto& [first, last] : dead.code) {
+        std::fill(remove.begin() + static_cast<std::ptrdiff_t>(first), remove.begin() + static_cast<std::ptrdiff_t>(last), true);
+    }
+    for (std::size_t i : dead.data) {
+        remove[i] = true;
+    }
+    // nothing that stays refers to the labels of what's removed
+    for (symbol_id_t id = 0; id < m_symbols.size(); ++id) {
+        const Symbol& symbol = m_symbols[id];
+        if (symbol.kind == SymbolKind::Label && !symbol.removed && symbol.address < m_program.size() && remove[symbol.address]) {
+            m_symbols.remove(id);
+        }
+    }
+    // the labels of removed jumps move on to where they jumped to
+    for (std::size_t i : dead.jumps) {
+        remove[i] = true;
+    }
+    const auto removed = static_cast<std::size_t>(std::count(remove.begin(), remove.end(), true));
+    remove_rows(remove, in_call);
+    m_uses_ret = uses_ret();
+    return removed;
+}
+
+std::vector<bool> Parser::data_may_run() const {
+    const Program&    program = m_program;
+    std::vector<bool> runs(program.size(), true);
+    for (std::size_t i = 1; i < program.size(); ++i) {
+        const Instr before = program.instr(i - 1);
+        if (program.instr(i) == Instr::DATA && !program.executed(i) && before != Instr::JMP && before != Instr::STP) {
+            runs[i] = runs[i - 1];
+        } else if (program.instr(i) == Instr::DATA && !program.executed(i)) {
+            runs[i] = false;
+        }
+        if (m_symbols.find_at(SymbolKind::Label, static_cast<std::uint32_t>(i)) != INVALID_SYMBOL) {
+            runs[i] = true;
+        }
+    }
+    return runs;
+}
+
+void Parser::move_labels(const std::vector<std::size_t>& new_index) {
+    for (symbol_id_t id = 0; id < m_symbols.size(); ++id) {
+        const Symbol& symbol = m_symbols[id];
+        if (symbol.kind == SymbolKind::Label && !symbol.removed) {
+            m_symbols.set_address(id, static_cast<std::uint32_t>(new_index[symbol.address]));
+        }
+    }
+    for (std::size_t& site : m_call_sites) {
+        site = new_index[site];
+        set_call_return(site);
+    }
+}
+
+void Parser::remove_rows(const std::vector<bool>& remove, std::vector<bool>& in_call) {
+    std::vector<std::size_t> new_index(m_program.size() + 1);
+    std::size_t              kept = 0;
+    for (std::size_t i = 0; i < m_program.size(); ++i) {
+        new_index[i] = kept;
+        if (!remove[i]) {
+            in_call[kept] = in_call[i];
+            ++kept;
+        }
+    }
+    new_index[m_program.size()] = kept;
+    m_program.remove(remove);
+    in_call.resize(kept);
+    std::erase_if(m_call_sites, [&](std::size_t site) {
+        return remove[site];
+    });
+    move_labels(new_index);
+}
+
+std::string_view Parser::call_target(std::size_t site) const {
+    if (m_calls == CallConvention::Stack) {
+        return m_program.arg(site + 1).substr(std::strlen(Prefix::VAR) + std::strlen("__jmp__"));
+    }
+    return m_program.arg(site + call_size() - 1);
+}
+
+bool Parser::is_ret(std::size_t i) const {
+    return m_program.instr(i) == Instr::JMP && m_program.arg(i) == (m_calls == CallConvention::Stack ? ".__ret" : SUBR_PC_LOC);
+}
+
+bool Parser::uses_ret() const {
+    for (std::size_t i = 0; i < m_program.size(); ++i) {
+        if (is_ret(i)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::size_t Parser::inline_calls(std::size_t max_size) {
+    if (m_invalid || !m_instrs.empty() || m_call_sites.empty()) {
+        return 0;
+    }
+    Program&          program = m_program;
+    std::vector<bool> in_call = call_rows();
+    if (!code_is_movable(in_call)) {
+        return 0;
+    }
+
+    // a leaf is everything from its label up to the first ret, as long as it
+    //  has no calls or data in it and only jumps within itself
+    struct Leaf {
+        std::size_t begin;
+        std::size_t end;
+        bool        inlined;
+        bool        keep;
+    };
+    std::vector<Leaf>         leaves;
+    std::vector<std::size_t>  leaf_of_site(m_call_sites.size(), SIZE_MAX);
+    for (std::size_t s = 0; s < m_call_sites.size(); ++s) {
+        const std::string_view target = call_target(m_call_sites[s]);
+        if (!is_label(target) || label_address(target) >= program.size()) {
+            continue;
+        }
+        const std::size_t begin = label_address(target);
+        auto              known = std::find_if(leaves.begin(), leaves.end(), [&](const Leaf& leaf) {
+            return leaf.begin == begin;
+        });
+        if (known != leaves.end()) {
+            leaf_of_site[s] = static_cast<std::size_t>(known - leaves.begin());
+            continue;
+        }
+        std::size_t end = begin;
+        while (end < program.size() && end - begin <= max_size && !in_call[end] && program.instr(end) != Instr::DATA && !is_ret(end)) {
+            ++end;
+        }
+        bool leaf = end < program.size() && end - begin <= max_size && is_ret(end);
+        for (std::size_t i = begin; leaf && i < end; ++i) {
+            if (is_jump(program.instr(i))) {
+                const std::size_t to = label_address(program.arg(i));
+                leaf                 = is_label(program.arg(i)) && to >= begin && to <= end;
+            }
+        }
+        leaves.push_back(Leaf { begin, end, leaf, true });
+        leaf_of_site[s] = leaves.size() - 1;
+    }
+
+    // the original stays if anything but the inlined calls can get to it
+    std::vector<bool> replaced(program.size(), false);
+    for (std::size_t s = 0; s < m_call_sites.size(); ++s) {
+        if (leaf_of_site[s] != SIZE_MAX && leaves[leaf_of_site[s]].inlined) {
+            std::fill(replaced.begin() + static_cast<std::ptrdiff_t>(m_call_sites[s]),
+                replaced.begin() + static_cast<std::ptrdiff_t>(m_call_sites[s] + call_size()), true);
+        }
+    }
+    for (Leaf& leaf : leaves) {
+        if (!leaf.inlined) {
+            continue;
+        }
+        const Instr before = leaf.begin > 0 ? program.instr(leaf.begin - 1) : Instr::INVALID;
+        leaf.keep          = leaf.begin == 0 || (before != Instr::JMP && before != Instr::STP && !replaced[leaf.begin - 1]);
+        for (std::size_t i = 0; !leaf.keep && i < program.size(); ++i) {
+            if ((i >= leaf.begin && i <= leaf.end) || replaced[i] || !is_label(program.arg(i))) {
+                continue;
+            }
+            const std::size_t to = label_address(program.arg(i));
+            leaf.keep            = to >= leaf.begin && to <= leaf.end;
+        }
+    }
+    std::vector<bool> removed(program.size(), false);
+    for (const Leaf& leaf : leaves) {
+        if (leaf.inlined && !leaf.keep) {
+            std::fill(removed.begin() + static_cast<std::ptrdiff_t>(leaf.begin),
+                removed.begin() + static_cast<std::ptrdiff_t>(leaf.end + 1), true);
+        }
+    }
+
+    // labels of the copies are named after the original and the copy, and
+    //  so are the jumps of the copies
+    struct CopiedLabel {
+        std::string   name;
+        std::size_t   address;
+        std::uint32_t line;
+    };
+    std::vector<CopiedLabel>                      copied_labels;
+    std::vector<std::pair<std::size_t, arg_id_t>> copied_jumps;
+    std::vector<std::size_t>                      rows;
+    std::vector<std::size_t>                      new_index(program.size() + 1);
+    std::vector<std::size_t>                      sites;
+    std::size_t                                   inlined = 0;
+    std::size_t                                   s       = 0;
+    for (std::size_t i = 0; i < program.size();) {
+        while (s < m_call_sites.size() && m_call_sites[s] < i) {
+            ++s;
+        }
+        new_index[i] = rows.size();
+        if (s < m_call_sites.size() && m_call_sites[s] == i && replaced[i]) {
+            const Leaf&         leaf   = leaves[leaf_of_site[s]];
+            const std::size_t   start  = rows.size();
+            const std::string   suffix = "__inline_" + std::to_string(inlined++);
+            const std::uint32_t line   = program.loc(i).line;
+            for (std::size_t j = leaf.begin; j < leaf.end; ++j) {
+                if (is_jump(program.instr(j))) {
+                    copied_jumps.push_back({ rows.size(), program.intern({ program.arg(j), suffix }) });
+                }
+                rows.push_back(j);
+            }
+            for (std::size_t j = leaf.begin; j <= leaf.end; ++j) {
+                for (symbol_id_t id = m_symbols.first_at(static_cast<std::uint32_t>(j)); id != INVALID_SYMBOL; id = m_symbols[id].next_at_address) {
+                    if (m_symbols[id].kind == SymbolKind::Label) {
+                        copied_labels.push_back(CopiedLabel { std::string(m_symbols[id].name) + suffix, start + j - leaf.begin, line });
+                    }
+                }
+            }
+            for (std::size_t j = i + 1; j < i + call_size(); ++j) {
+                new_index[j] = start;
+            }
+            i += call_size();
+            continue;
+        }
+        if (s < m_call_sites.size() && m_call_sites[s] == i) {
+            sites.push_back(rows.size());
+        }
+        if (!removed[i]) {
+            rows.push_back(i);
+        }
+        ++i;
+    }
+    new_index[program.size()] = rows.size();
+    if (inlined == 0) {
+        return 0;
+    }
+
+    for (symbol_id_t id = 0; id < m_symbols.size(); ++id) {
+        const Symbol& symbol = m_symbols[id];
+        if (symbol.kind != SymbolKind::Label || symbol.removed) {
+            continue;
+        }
+        if (symbol.address < removed.size() && removed[symbol.address]) {
+            m_symbols.remove(id);
+        } else {
+            m_symbols.set_address(id, static_cast<std::uint32_t>(new_index[symbol.address]));
+        }
+    }
+    for (const CopiedLabel& label : copied_labels) {
+        // copies of labels nothing jumps to are never looked up, so a name
+        //  that's taken already doesn't matter
+        m_symbols.define(SymbolKind::Label, label.name, static_cast<std::uint32_t>(label.address), 0, label.line);
+    }
+    program.select(rows);
+    for (const auto& [row, arg] : copied_jumps) {
+        program.set_arg(row, arg);
+    }
+    m_call_sites = std::move(sites);
+    m_uses_ret   = uses_ret();
+    for (std::size_t site : m_call_sites) {
+        set_call_return(site);
+    }
+    return inlined;
+}
+
+std::size_t Parser::superoptimize(std::size_t max_length, SuperoptDatabase* database, std::size_t thread_count) {
+    if (m_invalid || !m_instrs.empty()) {
+        return 0;
+    }
+    Program&          program = m_program;
+    std::vector<bool> in_call = call_rows();
+    if (!code_is_movable(in_call)) {
+        return 0;
+    }
+
+    // runs only start at labels, so nothing can jump into the middle of one.
+    //  names of data are different words, so words of a run never overlap
+    struct Run {
+        std::size_t           first;
+        std::vector<arg_id_t> operands;
+        Sequence              sequence;
+        Sequence              result;
+    };
+    auto in_run = [&](std::size_t i) {
+        const Instr instr = program.instr(i);
+        return !in_call[i] && (instr == Instr::LDA || instr == Instr::STO || instr == Instr::ADD || instr == Instr::SUB)
+            && program.arg(i).substr(0, std::strlen(Prefix::VAR)) == Prefix::VAR;
+    };
+    std::vector<Run> runs;
+    for (std::size_t i = 0; i < program.size();) {
+        Run run { i, {}, {}, {} };
+        for (; i < program.size() && in_run(i) && run.sequence.size() < max_length; ++i) {
+            if (i != run.first && m_symbols.find_at(SymbolKind::Label, static_cast<std::uint32_t>(i)) != INVALID_SYMBOL) {
+                break;
+            }
+            auto operand = std::find(run.operands.begin(), run.operands.end(), program.arg_id(i));
+            if (operand == run.operands.end()) {
+                if (run.operands.size() == SUPEROPT_MAX_OPERANDS) {
+                    break;
+                }
+                run.operands.push_back(program.arg_id(i));
+                operand = run.operands.end() - 1;
+            }
+            run.sequence.push_back(SeqInstr { program.instr(i), static_cast<std::uint8_t>(operand - run.operands.begin()) });
+        }
+        if (run.sequence.empty()) {
+            ++i;
+        } else if (run.sequence.size() > 1) {
+            runs.push_back(std::move(run));
+        }
+    }
+
+    // runs that use different words the same way are searched once
+    std::map<std::string, std::vector<std::size_t>> same;
+    for (std::size_t r = 0; r < runs.size(); ++r) {
+        same[sequence_to_string(runs[r].sequence)].push_back(r);
+    }
+    auto search = [&](Run& run) {
+        if (database && database->find(run.sequence, run.operands.size(), run.result)) {
+            return;
+        }
+        run.result = ::superoptimize(run.sequence, run.operands.size());
+        if (database) {
+            database->insert(run.sequence, run.result);
+        }
+    };
+    if (thread_count == 1 || same.size() < 2) {
+        for (const auto& [text, indices] : same) {
+            search(runs[indices.front()]);
+        }
+    } else {
+        ThreadPool pool(thread_count);
+        for (const auto& [text, indices] : same) {
+            Run* run = &runs[indices.front()];
+            pool.submit([&search, run] {
+                search(*run);
+            });
+        }
+        pool.wait();
+    }
+
+    std::vector<bool> remove(program.size(), false);
+    std::size_t       removed = 0;
+    for (const auto& [text, indices] : same) {
+        const Sequence& result = runs[indices.front()].result;
+        for (std::size_t r : indices) {
+            Run& run = runs[r];
+            if (result.size() >= run.sequence.size()) {
+                continue;
+            }
+            log("replacing '" << text << "' at " << run.first << " with '" << sequence_to_string(result) << "'");
+            for (std::size_t j = 0; j < run.sequence.size(); ++j) {
+                if (j < result.size()) {
+                    program.set_instr(run.first + j, result[j].instr);
+                    program.set_arg(run.first + j, run.operands[result[j].operand]);
+                } else {
+                    remove[run.first + j] = true;
+                    ++removed;
+                }
+            }
+        }
+    }
+    if (removed > 0) {
+        remove_rows(remove, in_call);
+    }
+    return removed;
+}
+
+std::size_t Parser::optimize(const std::vector<PeepholeRule>& rules) {
+    if (m_invalid || !m_instrs.empty()) {
+        return 0;
+    }
+    const Program& program = m_program;
+    // the rows of a call refer to each other by address, so they're left alone
+    std::vector<bool> in_call = call_rows();
+    if (!code_is_movable(in_call)) {
+        return 0;
+    }
+
+    std::size_t removed = 0;
+    while (true) {
+        std::vector<bool> remove(program.size(), false);
+        bool              changed = false;
+        arg_id_t          acc     = NO_ARG;
+        for (std::size_t i = 0; i < program.size(); ++i) {
+            if (in_call[i] || m_symbols.find_at(SymbolKind::Label, static_cast<std::uint32_t>(i)) != INVALID_SYMBOL) {
+                acc = NO_ARG;
+            }
+            if (in_call[i]) {
+                continue;
+            }
+            PeepholeContext context { program, m_symbols, i, acc };
+            for (PeepholeRule rule : rules) {
+                if (rule(context)) {
+                    remove[i] = true;
+                    changed   = true;
+                    break;
+                }
+            }
+            if (remove[i]) {
+                // removed rows don't change what ACC holds
+                continue;
+            }
+            switch (program.instr(i)) {
+            case Instr::LDA:
+            case Instr::STO:
+                acc = program.arg_id(i);
+                break;
+            case Instr::JGE:
+            case Instr::JNE:
+                break;
+            default:
+                acc = NO_ARG;
+                break;
+            }
+        }
+        if (!changed) {
+            break;
+        }
+
+        removed += static_cast<std::size_t>(std::count(remove.begin(), remove.end(), true));
+        remove_rows(remove, in_call);
+    }
+    return removed;
+}
+
+std::size_t Parser::thread_jumps() {
+    if (m_invalid || !m_instrs.empty()) {
+        return 0;
+    }
+    Program&          program = m_program;
+    std::vector<bool> in_call = call_rows();
+    // this also makes sure no STO writes to an instruction, so a jump can't
+    //  be turned into something else while the program runs
+    if (!code_is_movable(in_call)) {
+        return 0;
+    }
+
+    // a jump to a `jmp` goes where that one goes. a conditional jump to the
+    //  same conditional jump does too, as ACC is still the same there
+    std::size_t changed = 0;
+    for (std::size_t i = 0; i < program.size(); ++i) {
+        if (in_call[i] || !is_jump(program.instr(i)) || !is_label(program.arg(i))) {
+            continue;
+        }
+        arg_id_t    arg  = program.arg_id(i);
+        std::size_t to   = label_address(program.text(arg));
+        std::size_t hops = 0;
+        // a chain that ends in a loop goes around it once at most
+        while (to < program.size() && !in_call[to] && is_label(program.arg(to)) && hops < program.size()
+               && (program.instr(to) == Instr::JMP || program.instr(to) == program.instr(i))) {
+            arg = program.arg_id(to);
+            to  = label_address(program.text(arg));
+            ++hops;
+        }
+        if (arg != program.arg_id(i)) {
+            log("'" << name_from_instr(program.instr(i)) << " " << program.arg(i) << "' now jumps to '" << program.text(arg) << "'");
+            program.set_arg(i, arg);
+            ++changed;
+        }
+    }
+
+    std::vector<bool> reachable;
+    if (!reachable_rows(reachable)) {
+        log("data may be run, not removing jumps");
+        return changed;
+    }
+    std::vector<bool> remove(program.size(), false);
+    std::size_t       removed = 0;
+    for (std::size_t i = 0; i < program.size(); ++i) {
+        if (!reachable[i] && !in_call[i] && program.instr(i) == Instr::JMP) {
+            remove[i] = true;
+            ++removed;
+        }
+    }
+    if (removed > 0) {
+        remove_rows(remove, in_call);
+    }
+    return changed + removed;
+}
+
+std::size_t Parser::merge_constants() {
+    if (m_invalid || !m_instrs.empty()) {
+        return 0;
+    }
+    Program&          program = m_program;
+    std::vector<bool> in_call = call_rows();
+    if (!code_is_movable(in_call)) {
+        return 0;
+    }
+    std::set<std::string_view> written;
+    for (std::size_t i = 0; i < program.size(); ++i) {
+        if (program.instr(i) == Instr::STO && program.arg(i).substr(0, std::strlen(Prefix::VAR)) == Prefix::VAR) {
+            written.insert(program.arg(i).substr(std::strlen(Prefix::VAR)));
+        }
+    }
+
+    // data that may run as an instruction has to stay where it is. the data
+    //  of a call is jumped over, but its value depends on where the call
+    //  is, so it's never the same as another one
+    std::map<std::uint16_t, std::string_view>    kept;
+    std::map<std::string_view, std::string_view> renamed;
+    std::vector<bool>                            remove(program.size(), false);
+    const std::vector<bool>                      runs = data_may_run();
+    for (std::size_t i = 0; i < program.size(); ++i) {
+        const std::string_view arg = program.arg(i);
+        if (program.instr(i) != Instr::DATA || runs[i] || in_call[i] || arg.find('=') == std::string_view::npos) {
+            continue;
+        }
+        const std::string_view name = trim_whitespace(arg.substr(0, arg.find('=')));
+        const std::string_view rhs  = trim_whitespace(arg.substr(arg.find('=') + 1));
+        if (name.empty() || !is_number(rhs) || written.count(name) > 0) {
+            continue;
+        }
+        auto [it, inserted] = kept.emplace(number_value(rhs), name);
+        if (!inserted) {
+            log("merging '" << name << "' into '" << it->second << "'");
+            remove[i] = true;
+            renamed.emplace(name, it->second);
+            m_merged_data.push_back(MergedData { name, it->second, program.loc(i).line });
+        }
+    }
+    if (renamed.empty()) {
+        return 0;
+    }
+
+    // references name the word that's kept, so the listing assembles to the same
+    for (std::size_t i = 0; i < program.size(); ++i) {
+        if (program.instr(i) == Instr::DATA || program.arg(i).substr(0, std::strlen(Prefix::VAR)) != Prefix::VAR) {
+            continue;
+        }
+        auto it = renamed.find(program.arg(i).substr(std::strlen(Prefix::VAR)));
+        if (it != renamed.end()) {
+            program.set_arg(i, program.intern({ Prefix::VAR, it->second }));
+        }
+    }
+    remove_rows(remove, in_call);
+    return renamed.size();
+}
+
+std::size_t Parser::relocate_data() {
+    if (m_invalid || !m_instrs.empty()) {
+        return 0;
+    }
+    Program&          program = m_program;
+    std::vector<bool> in_call = call_rows();
+    if (!code_is_movable(in_call)) {
+        return 0;
+    }
+    const std::vector<bool> runs = data_may_run();
+    std::vector<bool>       moved(program.size(), false);
+    bool                    in_the_way = false;
+    for (std::size_t i = 0; i < program.size(); ++i) {
+        if (program.instr(i) == Instr::DATA && !runs[i] && !in_call[i]) {
+            moved[i] = true;
+        } else if (i > 0 && moved[i - 1]) {
+            in_the_way = true;
+        }
+    }
+    if (!in_the_way) {
+        return 0;
+    }
+
+    // a jmp over nothing but data that moves jumps to the next instruction
+    //  once it's gone. no label can be in between, as labelled data stays
+    std::vector<bool> remove(program.size(), false);
+    for (std::size_t i = 0; i < program.size(); ++i) {
+        if (in_call[i] || program.instr(i) != Instr::JMP || !is_label(program.arg(i))) {
+            continue;
+        }
+        const std::size_t to = label_address(program.arg(i));
+        if (to > i + 1 && to <= program.size()
+            && std::all_of(moved.begin() + static_cast<std::ptrdiff_t>(i + 1), moved.begin() + static_cast<std::ptrdiff_t>(to), [](bool m) { return m; })) {
+            remove[i] = true;
+        }
+    }
+    // the data would be run if the last of the code that stays goes on to
+    //  the next word, where it never was before
+    for (std::size_t i = program.size(); i-- > 0;) {
+        if (!moved[i] && !remove[i]) {
+            if (program.instr(i) != Instr::JMP && program.instr(i) != Instr::STP) {
+                return 0;
+            }
+            break;
+        }
+    }
+
+    // code keeps its order, the data goes after all of it in the order it
+    //  was declared. labels of removed jumps move to the next instruction
+    //  that stays
+    std::vector<std::size_t> rows;
+    std::vector<std::size_t> new_index(program.size() + 1);
+    rows.reserve(program.size());
+    for (std::size_t i = 0; i < program.size(); ++i) {
+        new_index[i] = rows.size();
+        if (!moved[i] && !remove[i]) {
+            rows.push_back(i);
+        }
+    }
+    for (std::size_t i = 0; i < program.size(); ++i) {
+        if (moved[i]) {
+            rows.push_back(i);
+        }
+    }
+    new_index[program.size()] = rows.size();
+    program.select(rows);
+    move_labels(new_index);
+    return static_cast<std::size_t>(std::count(remove.begin(), remove.end(), true));
+}
+
+void Parser::add_call_runtime() {
+    // return addresses and call targets, the same target only once. both
+    //  are views into the texts of the program, which outlive this
+    std::vector<arg_id_t>      constants;
+    std::set<std::string_view> targets;
+    for (std::size_t site : m_call_sites) {
+        const std::string_view name   = m_program.arg(site + 1).substr(std::strlen(Prefix::VAR));
+        const std::string_view target = name.substr(std::strlen("__jmp__"));
+        m_loc                         = m_program.loc(site);
+        if (!targets.insert(target).second) {
+            continue;
+        }
+        std::uint16_t address = 0;
+        if (target.substr(0, std::strlen(Prefix::LABEL)) == Prefix::LABEL) {
+            address = resolve_name(target);
+        } else if (evaluate_number_format(target) != NumberFormat::None) {
+            address = parse_number(target);
+        } else {
+            report_error("a call through the return stack needs a label or an address, not '" << target << "'");
+        }
+        instruction_t jump {};
+        jump.opcode = JMP;
+        jump.S      = address;
+        constants.push_back(m_program.intern({ name, "=", as_hex_string(word_from_instr(jump)) }));
+    }
+    for (std::size_t site : m_call_sites) {
+        const std::string_view name = m_program.arg(site + 3).substr(std::strlen(Prefix::VAR));
+        instruction_t          jump {};
+        jump.opcode = JMP;
+        jump.S      = static_cast<std::uint16_t>(site + call_size());
+        constants.push_back(m_program.intern({ name, "=", as_hex_string(word_from_instr(jump)) }));
+    }
+
+    // the stack starts right after all of this and grows up
+    static constexpr std::size_t routine_size = 14;
+    const std::size_t            stack        = m_program.size() + routine_size + 3 + constants.size();
+    const source_location_t      loc { 0, 0 };
+    auto                         label = [&](std::string_view name) {
+        m_loc = loc;
+        parse_label(name, static_cast<std::uint32_t>(m_program.size()));
+    };
+    auto add = [&](Instr instr, std::string_view arg) {
+        m_program.push_back(instr, arg, loc);
+    };
+
+    // stores acc (the return jump) on top of the stack and moves the top
+    //  up by changing the address of the sto itself
+    label(".__push:");
+    label(".__push_slot:");
+    add(STO, as_hex_string(static_cast<std::uint32_t>(stack)));
+    add(LDA, ".__push_slot");
+    add(ADD, "$__one");
+    add(STO, ".__push_slot");
+    add(LDA, "$__acc");
+    // the call stores the jump to its target here
+    label(".__call_jump:");
+    add(JMP, "0x0");
+    // moves the top down again, and jumps to the return jump on it
+    label(".__ret:");
+    add(STO, "$__acc");
+    add(LDA, ".__push_slot");
+    add(SUB, "$__one");
+    add(STO, ".__push_slot");
+    add(ADD, "$__sto_to_jmp");
+    add(STO, ".__ret_jump");
+    add(LDA, "$__acc");
+    label(".__ret_jump:");
+    add(JMP, "0x0");
+
+    add(DATA, "__acc=0");
+    add(DATA, "__one=1");
+    // turns `sto x` into `jmp x`
+    add(DATA, "__sto_to_jmp=0x3000");
+    for (arg_id_t constant : constants) {
+        m_program.push_back(DATA, constant, loc);
+    }
+}
+
 void Parser::parse_all() {
+    define_all_data();
+    encode_all();
+}
+
+void Parser::define_all_data() {
+    if (m_calls == CallConvention::Stack && (!m_call_sites.empty() || m_uses_ret) && !m_invalid) {
+        add_call_runtime();
+    }
+    check_size();
     // first parse data segments
-    for (std::uint16_t i = 0; i < m_instr_arg_pairs.size(); ++i) {
-        auto pair = m_instr_arg_pairs.at(i);
-        if (pair.instr == Instr::DATA) {
-            parse_data(pair, i);
-        }
-    }
-    for (std::uint16_t i = 0; i < m_instr_arg_pairs.size(); ++i) {
-        auto pair = m_instr_arg_pairs.at(i);
-
-        instruction_t raw_instr;
-        if (is_standard_instr(pair.instr)) {
-            parse_standard(pair, raw_instr);
-        } else if (pair.instr == Instr::DATA) {
-            write_data_segment(i, raw_instr);
-        } else if (pair.instr == Instr::LABEL) {
-            // already handled, early breakout
-            continue;
-        } else if (pair.instr == Instr::CALL
-                   || pair.instr == Instr::RET) {
-            // already handled, early breakout
+    define_data(0, m_program.size());
+    for (const MergedData& merged : m_merged_data) {
+        symbol_id_t into = m_symbols.find(SymbolKind::Data, merged.into);
+        if (into == INVALID_SYMBOL) {
             continue;
+        }
+        if (m_symbols.define(SymbolKind::Data, merged.name, m_symbols[into].address, m_symbols[into].value, merged.line) == INVALID_SYMBOL) {
+            m_loc = source_location_t { merged.line, 0 };
+            report_error("data '" << merged.name << "' is declared more than once");
+        }
+    }
+}
+
+void Parser::check_size() {
+    const std::size_t size = m_program.size();
+    if (size > MEMORY_WORDS) {
+        m_loc = m_program.loc(MEMORY_WORDS);
+        report_error("the program is " << size << " words long, but memory only holds " << MEMORY_WORDS << ", this is the first word past it");
+    }
+}
+
+void Parser::encode_all() {
+    const std::size_t size    = m_program.size();
+    const std::size_t threads = std::min(worker_count(), size / PARALLEL_ENCODE_ROWS);
+    if (threads <= 1) {
+        encode(0, size);
+        return;
+    }
+    m_instrs.resize(size);
+    m_arg_symbols.resize(size, INVALID_SYMBOL);
+    // rows that would report an error are left for later, per thread
+    std::vector<std::vector<std::size_t>> failed(threads);
+    {
+        ThreadPool pool(threads);
+        for (std::size_t t = 0; t < threads; ++t) {
+            pool.submit([&, t] {
+                for (std::size_t i = size * t / threads; i < size * (t + 1) / threads; ++i) {
+                    if (!encode_quietly(i)) {
+                        failed[t].push_back(i);
+                    }
+                }
+            });
+        }
+        pool.wait();
+    }
+    std::size_t failed_count = 0;
+    for (const auto& indices : failed) {
+        failed_count += indices.size();
+    }
+    add_stat(StatCounter::InstructionsEmitted, size - failed_count);
+    // encoded again on this thread and in order, so they report the same
+    //  diagnostics as encoding everything on one
+    for (const auto& indices : failed) {
+        for (std::size_t i : indices) {
+            encode(i, i + 1);
+        }
+    }
+    m_loc         = m_program.loc(size - 1);
+    m_last_symbol = m_arg_symbols.back();
+}
+
+void Parser::define_data(std::size_t first, std::size_t last) {
+    for (std::size_t i = first; i < last; ++i) {
+        if (m_program.instr(i) == Instr::DATA) {
+            m_loc = m_program.loc(i);
+            parse_data(i);
+        }
+    }
+}
+
+void Parser::encode(std::size_t first, std::size_t last) {
+    // labels, calls and returns never make it into the program, so there is one instruction per row
+    m_instrs.resize(m_program.size());
+    m_arg_symbols.resize(m_program.size(), INVALID_SYMBOL);
+    for (std::size_t i = first; i < last; ++i) {
+        const Instr instr = m_program.instr(i);
+        m_loc             = m_program.loc(i);
+        m_last_symbol     = INVALID_SYMBOL;
+
+        instruction_t raw_instr {};
+        if (is_standard_instr(instr)) {
+            parse_standard(i, raw_instr);
+        } else if (instr == Instr::DATA) {
+            write_data_segment(static_cast<std::uint32_t>(i), raw_instr);
         } else {
-            error("no parser found for '" << name_from_instr(pair.instr) << "'");
-            m_invalid = true;
+            report_error("no parser found for '" << name_from_instr(instr) << "'");
+        }
+        m_instrs[i]      = raw_instr;
+        m_arg_symbols[i] = m_last_symbol;
+    }
+    add_stat(StatCounter::InstructionsEmitted, last > first ? last - first : 0);
+}
+
+bool Parser::encode_quietly(std::size_t i) {
+    const Instr            instr = m_program.instr(i);
+    const std::string_view arg   = m_program.arg(i);
+    instruction_t          raw_instr {};
+    symbol_id_t            symbol = INVALID_SYMBOL;
+    if (is_standard_instr(instr)) {
+        raw_instr.opcode = static_cast<std::uint16_t>(instr);
+        if (instr_expects_arg(instr)) {
+            if (arg.empty()) {
+                return false;
+            }
+            bool valid = true;
+            switch (number_format_of(arg, valid)) {
+            case NumberFormat::None: {
+                if (!valid) {
+                    return false;
+                }
+                const bool is_var = arg.starts_with(Prefix::VAR);
+                if (!is_var && !arg.starts_with(Prefix::LABEL)) {
+                    return false;
+                }
+                symbol = m_symbols.find(is_var ? SymbolKind::Data : SymbolKind::Label, arg.substr(std::strlen(is_var ? Prefix::VAR : Prefix::LABEL)));
+                if (symbol == INVALID_SYMBOL) {
+                    return false;
+                }
+                raw_instr.S = static_cast<std::uint16_t>(m_symbols[symbol].address);
+                break;
+            }
+            case NumberFormat::Hex:
+                raw_instr.S = number_from_string(arg.substr(2), 16);
+                break;
+            case NumberFormat::Dec:
+                raw_instr.S = number_from_string(arg, 10);
+                break;
+            case NumberFormat::Bin:
+                return false;
+            }
         }
-        m_instrs.push_back(raw_instr);
+    } else if (instr == Instr::DATA) {
+        const symbol_id_t data = m_symbols.find_at(SymbolKind::Data, static_cast<std::uint32_t>(i));
+        if (data == INVALID_SYMBOL) {
+            return false;
+        }
+        raw_instr = instr_from_word(m_symbols[data].value);
+    } else {
+        return false;
     }
+    m_instrs[i]      = raw_instr;
+    m_arg_symbols[i] = symbol;
+    return true;
 }
 
 bool Parser::write_to(const std::string& filename) {
@@ -235,86 +1676,89 @@ bool Parser::write_to(const std::string& filename) {
     return true;
 }
 
-void Parser::write_data_segment(uint16_t address, instruction_t& raw_instr) {
-    auto iter = std::find_if(m_data_map.begin(), m_data_map.end(),
-        [&](const auto& elem) -> bool {
-            return elem.second.address == address;
-        });
-    if (iter == m_data_map.end()) {
-        error("could not find address in data map (internal error)");
-        m_invalid = true;
+std::vector<std::uint16_t> Parser::image() const {
+    std::vector<std::uint16_t> words;
+    words.reserve(m_instrs.size());
+    for (const auto& i : m_instrs) {
+        words.push_back(word_from_instr(i));
+    }
+    return words;
+}
+
+void Parser::write_data_segment(std::uint32_t address, instruction_t& raw_instr) {
+    symbol_id_t id = m_symbols.find_at(SymbolKind::Data, address);
+    if (id == INVALID_SYMBOL) {
+        report_error("could not find address in data map (internal error)");
         return;
     }
+    Symbol& data = m_symbols[id];
     verbose("writing data '0x" << std::setfill('0') << std::setw(4) << std::hex
-                               << iter->second.value << "' for data named '"
-                               << iter->first << "'");
-    raw_instr = reinterpret_cast<instruction_t&>(iter->second.value);
-}
-
-void Parser::parse_label(const std::string& s, uint16_t address) {
-    std::string s_trimmed = trim_whitespace(s);
-    s_trimmed             = s_trimmed.substr(std::strlen(Prefix::LABEL));
-    auto iter             = s_trimmed.find(':');
-    if (iter == std::string::npos) {
-        error("label declaration '" << s << "' expects ':' at the end");
-        m_invalid = true;
+                               << data.value << "' for data named '"
+                               << data.name << "'");
+    raw_instr = instr_from_word(data.value);
+}
+
+void Parser::parse_label(std::string_view s, std::uint32_t address) {
+    std::string_view s_trimmed = trim_whitespace(s);
+    s_trimmed                  = s_trimmed.substr(std::strlen(Prefix::LABEL));
+    auto iter                  = s_trimmed.find(':');
+    if (iter == std::string_view::npos) {
+        report_error("label declaration '" << s << "' expects ':' at the end");
         return;
     }
     s_trimmed = s_trimmed.substr(0, s_trimmed.size() - 1);
-    m_label_map.emplace(std::move(s_trimmed), std::move(address));
+    if (m_symbols.define(SymbolKind::Label, s_trimmed, address, 0, m_loc.line) == INVALID_SYMBOL) {
+        report_error("label '" << s_trimmed << "' is declared more than once");
+    }
 }
 
-void Parser::parse_data(const instr_arg_pair_t& pair, uint16_t address) {
+void Parser::parse_data(std::size_t i) {
+    const std::string_view arg = m_program.arg(i);
     // should only be called on data
-    assert(pair.instr == Instr::DATA);
+    assert(m_program.instr(i) == Instr::DATA);
     // this is handled earlier
-    assert(!pair.arg.empty());
+    assert(!arg.empty());
     // check for format 'name=N'
-    if (pair.arg.find('=') == std::string::npos) {
-        error("invalid format for data: '" << pair.arg << "', must be of format 'name=N'");
-        m_invalid = true;
+    if (arg.find('=') == std::string_view::npos) {
+        report_error("invalid format for data: '" << arg << "', must be of format 'name=N'");
         return;
     }
-    std::string name = pair.arg.substr(0, pair.arg.find('='));
-    std::string rhs;
+    std::string_view name = arg.substr(0, arg.find('='));
+    std::string_view rhs;
     // check if there even is a rhs (name + 1 is 'name='),
     // otherwise the substr fails. if this fails then rhs is
     // empty and this triggers an error a few lines down
-    if (name.size() + 1 < pair.arg.size())
-        rhs = pair.arg.substr(pair.arg.find('=') + 1);
+    if (name.size() + 1 < arg.size())
+        rhs = arg.substr(arg.find('=') + 1);
 
     name = trim_whitespace(name);
     rhs  = trim_whitespace(rhs);
 
     if (name.empty()) {
-        error("in argument '" << pair.arg << "' to data: name cannot be empty");
-        m_invalid = true;
+        report_error("in argument '" << arg << "' to data: name cannot be empty");
         return;
     }
     if (rhs.empty()) {
-        error("in argument '" << pair.arg << "' to data: right hand side cannot be empty");
-        m_invalid = true;
+        report_error("in argument '" << arg << "' to data: right hand side cannot be empty");
         return;
     }
 
     // rhs needs to be a number
     auto format = evaluate_number_format(rhs);
     if (format == NumberFormat::None) {
-        error("in right hand side '" << rhs << "' in data argument '"
-                                     << pair.arg << "': right hand side has to be a value type (number)");
-        m_invalid = true;
+        report_error("in right hand side '" << rhs << "' in data argument '"
+                                            << arg << "': right hand side has to be a value type (number)");
     }
 
-    DataInfo dat;
-    dat.value   = parse_number(rhs);
-    dat.address = address;
-
-    m_data_map.emplace(std::move(name), std::move(dat));
+    if (m_symbols.define(SymbolKind::Data, name, static_cast<std::uint32_t>(i), parse_number(rhs), m_program.loc(i).line) == INVALID_SYMBOL) {
+        report_error("data '" << name << "' is declared more than once");
+    }
 }
 
-void Parser::parse_standard(const instr_arg_pair_t& pair, instruction_t& raw_instr) {
+void Parser::parse_standard(std::size_t i, instruction_t& raw_instr) {
+    const Instr instr = m_program.instr(i);
     // FIXME: This can probably be a map
-    switch (pair.instr) {
+    switch (instr) {
     case LDA:
     case STO:
     case ADD:
@@ -324,7 +1768,7 @@ void Parser::parse_standard(const instr_arg_pair_t& pair, instruction_t& raw_ins
     case JNE:
     case STP:
         // Instr enum defines these as their opcode values already
-        raw_instr.opcode = static_cast<std::uint16_t>(pair.instr);
+        raw_instr.opcode = static_cast<std::uint16_t>(instr);
         break;
     case CALL:
     case RET:
@@ -336,43 +1780,60 @@ void Parser::parse_standard(const instr_arg_pair_t& pair, instruction_t& raw_ins
         assert(false);
     }
 
-    if (!instr_expects_arg(pair.instr)) {
+    if (!instr_expects_arg(instr)) {
         // early return for instructions without arguments
         raw_instr.S = 0;
         return;
     }
     // sanity check
-    assert(!pair.arg.empty());
-    parse_arg(pair.arg, raw_instr);
+    assert(!m_program.arg(i).empty());
+    parse_arg(m_program.arg(i), raw_instr);
 }
 
-void Parser::parse_arg(const std::string& arg, instruction_t& raw_instr) {
+void Parser::parse_arg(std::string_view arg, instruction_t& raw_instr) {
     switch (evaluate_number_format(arg)) {
     case NumberFormat::None:
         raw_instr.S = resolve_name(arg);
         verbose(arg << " has number format None");
         break;
     case NumberFormat::Hex:
-        raw_instr.S = static_cast<std::uint16_t>(std::stoul(arg, nullptr, 16));
+        raw_instr.S = number_from_string(arg.substr(2), 16);
         verbose(arg << " has number format Hex");
         break;
     case NumberFormat::Dec:
-        raw_instr.S = static_cast<std::uint16_t>(std::stoul(arg, nullptr, 10));
+        raw_instr.S = number_from_string(arg, 10);
         verbose(arg << " has number format Dec");
         break;
     case NumberFormat::Bin:
-        error("binary number format is not yet implemented.");
-        m_invalid = true;
+        report_error("binary number format is not yet implemented.");
         break;
     }
 }
 
-Parser::NumberFormat Parser::evaluate_number_format(const std::string& arg) {
+Parser::NumberFormat Parser::evaluate_number_format(std::string_view arg) {
+    bool               valid  = true;
+    const NumberFormat format = number_format_of(arg, valid);
+    if (valid) {
+        return format;
+    }
+    if (arg.starts_with("0x")) {
+        report_error("argument '" << arg << "' starts with '0x' like "
+                                  << " a hex number, but isn't valid hex.");
+    } else {
+        report_error("argument '" << arg << "' starts with a digit like "
+                                  << "a decimal number, but is not a "
+                                  << "valid decimal number format.");
+    }
+    return NumberFormat::None;
+}
+
+Parser::NumberFormat Parser::number_format_of(std::string_view arg, bool& valid) {
     // number formats:
     //  - HEX: 0xN
     //  - DEC: N
     //  - BIN: 0bN // not supported (yet)
 
+    valid = true;
     if (arg.find("0x") == 0) {
         // it's probably hex
         // we now check that the rest of it is only hex-digits.
@@ -384,23 +1845,18 @@ Parser::NumberFormat Parser::evaluate_number_format(const std::string& arg) {
                 return std::isxdigit(static_cast<unsigned char>(c)) != 0;
             })
             == arg.end()) {
-            error("argument '" << arg << "' starts with '0x' like "
-                               << " a hex number, but isn't valid hex.");
-            m_invalid = true;
+            valid = false;
             return NumberFormat::None;
         }
         // now we know it's definitely hex
         return NumberFormat::Hex;
-    } else if (std::isdigit(arg.at(0))) {
+    } else if (std::isdigit(static_cast<unsigned char>(arg.at(0)))) {
         // it's probably dec
         if (std::find_if(arg.begin(), arg.end(), [&](auto& c) {
-                return std::isdigit(c) != 0;
+                return std::isdigit(static_cast<unsigned char>(c)) != 0;
             })
             == arg.end()) {
-            error("argument '" << arg << "' starts with a digit like "
-                               << "a decimal number, but is not a "
-                               << "valid decimal number format.");
-            m_invalid = true;
+            valid = false;
             return NumberFormat::None;
         }
         // we are pretty sure it's decimal now
@@ -410,60 +1866,51 @@ Parser::NumberFormat Parser::evaluate_number_format(const std::string& arg) {
     }
 }
 
-uint16_t Parser::parse_number(const std::string& arg) {
+uint16_t Parser::parse_number(std::string_view arg) {
     switch (evaluate_number_format(arg)) {
     case NumberFormat::Hex:
-        return static_cast<std::uint16_t>(std::stoul(arg, nullptr, 16));
+        return number_from_string(arg.substr(2), 16);
         verbose(arg << " has number format Hex");
     case NumberFormat::Dec:
-        return static_cast<std::uint16_t>(std::stoul(arg, nullptr, 10));
+        return number_from_string(arg, 10);
         verbose(arg << " has number format Dec");
     case NumberFormat::Bin:
         // not implemented
     case NumberFormat::None:
-        error("argument '" << arg << "' is not a number");
-        m_invalid = true;
+        report_error("argument '" << arg << "' is not a number");
     }
     return 0;
 }
 
-void Parser::parse_subroutine(const instr_arg_pair_t& pair, instruction_t& raw_instr) {
-    error("not implemented");
-    m_invalid = true;
+void Parser::parse_subroutine(std::size_t i, instruction_t& raw_instr) {
+    report_error("not implemented");
 }
 
-uint16_t Parser::resolve_name(const std::string& name) {
-    if (name.find(Prefix::VAR) == std::string::npos
-        && name.find(Prefix::LABEL) == std::string::npos) {
-        error("usage of name '" << name << "' requires prefix '" << Prefix::VAR << "'");
-        m_invalid = true;
+uint16_t Parser::resolve_name(std::string_view name) {
+    const bool is_var   = name.substr(0, std::strlen(Prefix::VAR)) == Prefix::VAR;
+    const bool is_label = name.substr(0, std::strlen(Prefix::LABEL)) == Prefix::LABEL;
+    if (!is_var && !is_label) {
+        report_error("usage of name '" << name << "' requires prefix '" << Prefix::VAR << "'");
         return 0;
     }
 
-    if (name.find(Prefix::VAR) != std::string::npos) {
-        std::string trimmed_name = name.substr(std::strlen(Prefix::VAR));
-        auto        found        = std::find_if(m_data_map.begin(), m_data_map.end(),
-            [&](auto& elem) -> bool {
-                return elem.first == trimmed_name;
-            });
-        if (found != m_data_map.end()) {
+    if (is_var) {
+        symbol_id_t found = m_symbols.find(SymbolKind::Data, name.substr(std::strlen(Prefix::VAR)));
+        if (found != INVALID_SYMBOL) {
             verbose("found var prefix in " << name);
-            return found->second.address;
+            m_last_symbol = found;
+            return static_cast<std::uint16_t>(m_symbols[found].address);
         }
-    } else if (name.find(Prefix::LABEL) != std::string::npos) {
-        std::string trimmed_name = name.substr(std::strlen(Prefix::LABEL));
-        auto        other_found  = std::find_if(m_label_map.begin(), m_label_map.end(),
-            [&](auto& elem) -> bool {
-                return elem.first == trimmed_name;
-            });
-        if (other_found != m_label_map.end()) {
+    } else {
+        symbol_id_t found = m_symbols.find(SymbolKind::Label, name.substr(std::strlen(Prefix::LABEL)));
+        if (found != INVALID_SYMBOL) {
             verbose("found label prefix in " << name);
-            return other_found->second;
+            m_last_symbol = found;
+            return static_cast<std::uint16_t>(m_symbols[found].address);
         }
     }
 
     // at this point the name could not be resolved
-    error("name '" << name << "' could not be resolved as data or label");
-    m_invalid = true;
+    report_error("name '" << name << "' could not be resolved as data or label");
     return 0;
 }
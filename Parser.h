@@ -1,15 +1,20 @@
 #ifndef PARSER_H
 #define PARSER_H
 
-#include <cstdint> // std::uint...
-#include <string>  // std::string
-#include <vector>  // std::vector
+#include <cstdint>     // std::uint...
+#include <string>      // std::string
+#include <string_view> // std::string_view
+#include <utility>     // std::pair
+#include <vector>      // std::vector
 #include "arch.h"
-
-struct DataInfo {
-    std::uint16_t address;
-    std::uint16_t value;
-};
+#include "ControlFlow.h"
+#include "DebugInfo.h"
+#include "Diagnostic.h"
+#include "Lexer.h"
+#include "Peephole.h"
+#include "Program.h"
+#include "Superopt.h"
+#include "SymbolTable.h"
 
 // hardcoded location in memory used for the value of pc
 // before a jump-into-subroutine (call). the location
@@ -19,6 +24,17 @@ struct DataInfo {
 // being used to store the PC in SUBR_PC_LOC
 #define SUBR_ACC_LOC "0xffe"
 
+// what Parser::find_dead_code found, as indices of rows of the program
+struct DeadCode {
+    // instructions that can't be reached, as ranges [first, last)
+    std::vector<std::pair<std::size_t, std::size_t>> code;
+    // data nothing refers to, besides dead code
+    std::vector<std::size_t> data;
+    // jmps over nothing but dead code and data, which aren't needed anymore
+    //  once that's removed
+    std::vector<std::size_t> jumps;
+};
+
 class Parser
 {
     enum NumberFormat
@@ -30,34 +46,232 @@ class Parser
     };
 
 public:
-    Parser(const std::string& filename);
+    // large sources are parsed and encoded on up to thread_count threads, 0
+    //  is one per core. the result is the same as on a single thread
+    Parser(const std::string& filename, CallConvention calls = CallConvention::Inline, std::size_t thread_count = 1);
+    // parses a source that is already in memory
+    explicit Parser(SourceBuffer source, CallConvention calls = CallConvention::Inline, std::size_t thread_count = 1);
+
+    Parser(const Parser&) = delete;
+    Parser& operator=(const Parser&) = delete;
 
-    bool extract_arg(Instr instr, const std::string& line, std::size_t line_nr, std::string& arg);
-    void write_asm_to(const std::string& filename);
+    // with annotate, the listing starts every basic block with what it
+    //  costs and where it goes, see control_flow
+    void write_asm_to(const std::string& filename, bool annotate = false);
+    // writes the listing that write_asm_to writes into out, replacing its
+    //  contents. blocks of flow are annotated if it's valid
+    void write_listing(std::string& out, const ControlFlow* flow = nullptr) const;
     bool write_to(const std::string& filename);
     void parse_all();
-    void write_data_segment(std::uint16_t address, instruction_t& raw_instr);
-    void parse_label(const std::string& s, std::uint16_t address);
-    void parse_data(const instr_arg_pair_t& pair, std::uint16_t address);
-    void parse_standard(const instr_arg_pair_t& pair, instruction_t& raw_instr);
-    void parse_arg(const std::string& arg, instruction_t& raw_instr);
-    void parse_subroutine(const instr_arg_pair_t& pair, instruction_t& raw_instr);
+    // the two passes of parse_all, for timing them apart: defining all
+    //  data (and adding the runtime of CallConvention::Stack), then
+    //  encoding every instruction
+    void define_all_data();
+    void encode_all();
+    // replaces calls of subroutines of up to max_size instructions, which
+    //  don't call anything themselves, with a copy of the subroutine.
+    //  subroutines nothing else refers to anymore are removed. has to be
+    //  called before parse_all. returns how many calls were replaced
+    std::size_t inline_calls(std::size_t max_size);
+    // points jumps to labels that just jump on to where that jump goes, and
+    //  removes jumps that can't be reached anymore. has to be called before
+    //  parse_all. returns how many jumps were changed or removed
+    std::size_t thread_jumps();
+    // keeps one word of every value the program declares as data but never
+    //  stores to, and points the names of the others at it. has to be
+    //  called before parse_all. returns how many words were removed
+    std::size_t merge_constants();
+    // moves data the program can't run into behind all code, and removes the
+    //  jumps that only jumped over it. data declared with `dx` stays. has to
+    //  be called before parse_all. returns how many jumps were removed
+    std::size_t relocate_data();
+    // finds instructions that can't be reached from the start of the
+    //  program, and data no instruction refers to. finds nothing if the
+    //  program may compute or change addresses of its own code, or run
+    //  data. has to be called before parse_all
+    DeadCode find_dead_code() const;
+    // removes what find_dead_code found, returns how many words that was
+    std::size_t remove_dead_code(const DeadCode& dead);
+    // replaces every run of up to max_length lda, sto, add and sub on data
+    //  with the shortest run that does the same, see superoptimize. runs
+    //  already in database aren't searched again, and new ones are added
+    //  to it. the searches run on thread_count threads, 0 is one per core.
+    //  has to be called before parse_all. returns how many instructions
+    //  were removed
+    std::size_t superoptimize(std::size_t max_length, SuperoptDatabase* database = nullptr, std::size_t thread_count = 1);
+    // where every word of the program came from, and its labels. has to be
+    //  called after parse_all
+    DebugInfo debug_info() const;
+    // the basic blocks of the program, the loops they form and the cycles
+    //  they take. a call is a block of its own, its subroutine is counted
+    //  separately. has to be called after parse_all
+    ControlFlow control_flow() const;
+    // removes instructions the rules find to be useless, until none of
+    //  them finds any more. has to be called before parse_all. returns
+    //  how many instructions were removed
+    std::size_t optimize(const std::vector<PeepholeRule>& rules = default_peephole_rules());
+    void write_data_segment(std::uint32_t address, instruction_t& raw_instr);
+    void parse_label(std::string_view s, std::uint32_t address);
+    // the parse_ functions take the row of the program they parse
+    void parse_data(std::size_t i);
+    void parse_standard(std::size_t i, instruction_t& raw_instr);
+    void parse_arg(std::string_view arg, instruction_t& raw_instr);
+    void parse_subroutine(std::size_t i, instruction_t& raw_instr);
 
-    NumberFormat  evaluate_number_format(const std::string& arg);
-    std::uint16_t parse_number(const std::string& arg);
-    std::uint16_t resolve_name(const std::string& name);
+    NumberFormat  evaluate_number_format(std::string_view arg);
+    // the format of arg without reporting anything, valid is false if it
+    //  looks like a number but isn't one
+    static NumberFormat number_format_of(std::string_view arg, bool& valid);
+    std::uint16_t parse_number(std::string_view arg);
+    std::uint16_t resolve_name(std::string_view name);
 
     bool invalid() const {
         return m_invalid;
     }
 
+    const std::vector<instruction_t>& instrs() const {
+        return m_instrs;
+    }
+    // the assembled program, as it's written by write_to
+    std::vector<std::uint16_t> image() const;
+
+    // the program before parse_all, one row per word
+    const Program& program() const {
+        return m_program;
+    }
+
+    // data and labels, as far as they were parsed
+    const SymbolTable& symbols() const {
+        return m_symbols;
+    }
+
+    // every error found so far, in the order they were found
+    const std::vector<Diagnostic>& diagnostics() const {
+        return m_diagnostics;
+    }
+
 protected:
+    // what lexing a part of the source found, without touching the parser
+    //  itself, so parts can be lexed on several threads. indices count from
+    //  the first row of the part
+    struct ParsedChunk {
+        // with the texts of its arguments, including the ones generated
+        //  for calls
+        Program program;
+        // index of the first row of every call expansion. their returns
+        //  aren't set yet, as they depend on where the part ends up
+        std::vector<std::size_t> call_sites;
+        // a label declaration, or an error if label is empty
+        struct Event {
+            std::string_view  label;
+            std::size_t       index;
+            source_location_t loc;
+            std::string       message;
+        };
+        // in the order of the source, so declaring and reporting them
+        //  afterwards gives the same symbols and diagnostics as doing it
+        //  while lexing
+        std::vector<Event> events;
+        // '\n' in the part
+        std::uint32_t     newlines = 0;
+        bool              uses_ret = false;
+        bool              empty    = true;
+        source_location_t last_loc { 0, 0 };
+    };
+
+    // lexes source into m_program. source may be a part of the file
+    //  starting at first_line, whose rows are inserted before row first_instr
+    void parse_source(std::string_view source, std::uint32_t first_line = 1, std::uint32_t first_instr = 0);
+    // lexes source, which starts at first_line, onto the end of chunk.program
+    void parse_chunk(std::string_view source, std::uint32_t first_line, ParsedChunk& chunk) const;
+    // splits source into parts of whole lines, lexes them on several threads
+    //  and puts them together in order, before row first_instr
+    void parse_source_parallel(std::string_view source, std::uint32_t first_line, std::uint32_t first_instr, std::size_t chunk_count);
+    // declares the labels, reports the errors and keeps the calls of a
+    //  part whose rows are in place already, from index offset and line
+    //  line_offset on
+    void add_chunk(ParsedChunk& chunk, std::size_t offset, std::uint32_t line_offset);
+    void expand_call(std::string_view target, source_location_t loc, ParsedChunk& chunk) const;
+    // (re)generates the arguments of a call expansion that depend on where it
+    //  is, first is the index of its first row
+    void set_call_return(std::size_t first) {
+        set_call_return(m_program, first, first);
+    }
+    // the same, for the expansion at row first of program, which ends up
+    //  at address
+    void set_call_return(Program& program, std::size_t first, std::size_t address) const;
+    // threads to parse and encode on, m_thread_count with 0 resolved
+    std::size_t worker_count() const;
+    // rows a call expands to
+    std::size_t call_size() const {
+        return m_calls == CallConvention::Stack ? 5 : 7;
+    }
+    // appends the routines, constants and stack CallConvention::Stack needs
+    void add_call_runtime();
+    // which rows belong to a call expansion
+    std::vector<bool> call_rows() const;
+    // what the call expansion starting at site calls
+    std::string_view call_target(std::size_t site) const;
+    bool             is_ret(std::size_t i) const;
+    // whether any row is a ret
+    bool uses_ret() const;
+    // false if moving instructions around would break the program, because
+    //  it refers to instructions by number or uses them as data
+    bool code_is_movable(const std::vector<bool>& in_call) const;
+    // index of the row a label argument points to, or past the end if
+    //  it isn't defined (yet)
+    std::size_t label_address(std::string_view arg) const;
+    // removes the marked rows, moving labels and calls along. labels of a
+    //  removed row move to the row after it
+    void remove_rows(const std::vector<bool>& remove, std::vector<bool>& in_call);
+    // points every label and call at new_index of where it is now
+    void move_labels(const std::vector<std::size_t>& new_index);
+    // which data may be run as an instruction: data with a label, data the
+    //  instruction before falls into, and `dx` data. true for everything else
+    std::vector<bool> data_may_run() const;
+    // which rows the program can get to from the start. false if it may
+    //  run data, which could go anywhere
+    bool reachable_rows(std::vector<bool>& reachable) const;
+    // reports an error if the program is longer than memory, as its
+    //  addresses past 0xfff would be cut down to 12 bits
+    void check_size();
+    // the two passes of parse_all, over the rows [first, last)
+    void define_data(std::size_t first, std::size_t last);
+    void encode(std::size_t first, std::size_t last);
+    // encodes row i like encode does, unless that would report an error.
+    //  touches nothing but the encoding of i, so it can run on several
+    //  threads. returns false if it didn't encode it
+    bool encode_quietly(std::size_t i);
+    // records an error at m_loc, which makes the parser invalid
+    void add_diagnostic(std::string message);
+
     // flag is set when an error occurs
-    bool                                 m_invalid = false;
-    std::map<std::string, DataInfo>      m_data_map;
-    std::map<std::string, std::uint16_t> m_label_map;
-    std::vector<instr_arg_pair_t>        m_instr_arg_pairs;
-    std::vector<instruction_t>           m_instrs;
+    bool                    m_invalid = false;
+    std::vector<Diagnostic> m_diagnostics;
+    // location of what's being parsed right now, for diagnostics
+    source_location_t       m_loc { 0, 0 };
+    SourceBuffer            m_source;
+    // data (`$`) and labels (`.`)
+    SymbolTable                m_symbols;
+    Program                    m_program;
+    std::vector<instruction_t> m_instrs;
+    // symbol each instruction's argument resolved to, or INVALID_SYMBOL
+    std::vector<symbol_id_t> m_arg_symbols;
+    // set by resolve_name
+    symbol_id_t m_last_symbol = INVALID_SYMBOL;
+    // index of the first row of every call expansion, in order
+    std::vector<std::size_t> m_call_sites;
+    CallConvention           m_calls    = CallConvention::Inline;
+    bool                     m_uses_ret = false;
+    std::size_t              m_thread_count = 1;
+    // data merge_constants removed, which parse_all defines at the word it
+    //  was merged into
+    struct MergedData {
+        std::string_view name;
+        std::string_view into;
+        std::uint32_t    line;
+    };
+    std::vector<MergedData> m_merged_data;
 };
 
 #endif // PARSER_H
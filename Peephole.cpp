@@ -0,0 +1,31 @@
+#include "Peephole.h"
+
+#include <cstring> // std::strlen
+
+bool remove_redundant_load(const PeepholeContext& context) {
+    const Program& program = context.program;
+    return program.instr(context.index) == Instr::LDA && context.acc != NO_ARG && program.arg_id(context.index) == context.acc;
+}
+
+bool remove_redundant_store(const PeepholeContext& context) {
+    const Program& program = context.program;
+    return program.instr(context.index) == Instr::STO && context.acc != NO_ARG && program.arg_id(context.index) == context.acc;
+}
+
+bool remove_jump_to_next(const PeepholeContext& context) {
+    const std::string_view arg = context.program.arg(context.index);
+    if (context.program.instr(context.index) != Instr::JMP || arg.substr(0, std::strlen(Prefix::LABEL)) != Prefix::LABEL) {
+        return false;
+    }
+    symbol_id_t label = context.symbols.find(SymbolKind::Label, arg.substr(std::strlen(Prefix::LABEL)));
+    return label != INVALID_SYMBOL && context.symbols[label].address == context.index + 1;
+}
+
+const std::vector<PeepholeRule>& default_peephole_rules() {
+    static const std::vector<PeepholeRule> rules = {
+        remove_redundant_load,
+        remove_redundant_store,
+        remove_jump_to_next,
+    };
+    return rules;
+}
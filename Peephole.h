@@ -0,0 +1,35 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <cstddef> // std::size_t
+#include <vector>  // std::vector
+#include "Program.h"
+#include "SymbolTable.h"
+
+// what a rule gets to see of the program, while Parser::optimize walks
+// through it front to back. labels are barriers: at a label, nothing is
+// known about the state of the machine.
+struct PeepholeContext {
+    const Program&     program;
+    const SymbolTable& symbols;
+    // the row the rule decides about
+    std::size_t index;
+    // the argument whose value ACC holds right now, or NO_ARG if unknown
+    arg_id_t acc;
+};
+
+// returns true if the row at context.index can be removed without
+// changing what the program does
+using PeepholeRule = bool (*)(const PeepholeContext& context);
+
+// `lda x` when ACC already holds x, for example right after `sto x`
+bool remove_redundant_load(const PeepholeContext& context);
+// `sto x` when x already holds ACC, for example right after `lda x`
+bool remove_redundant_store(const PeepholeContext& context);
+// `jmp .label` where .label is the next instruction
+bool remove_jump_to_next(const PeepholeContext& context);
+
+// the rules -O uses
+const std::vector<PeepholeRule>& default_peephole_rules();
+
+#endif // PEEPHOLE_H
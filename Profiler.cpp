@@ -0,0 +1,146 @@
+#include "Profiler.h"
+
+#include <algorithm> // std::sort, std::min, std::any_of
+#include <iomanip>   // std::setw, std::fixed, std::setprecision
+#include <map>       // std::map
+#include <sstream>   // std::ostringstream
+
+#include "Parser.h"
+#include "utility.h"
+
+namespace {
+// cycles of one source line, or of one kind of overhead
+struct LineCost {
+    std::uint32_t line    = 0;
+    std::uint16_t address = 0;
+    std::uint64_t cycles  = 0;
+    // how often its first word ran
+    std::uint64_t times = 0;
+    WordKind      kind  = WordKind::Code;
+};
+
+// '.label', '.label+3', or the address if there is no label before it
+std::string where(const DebugInfo& debug, std::uint16_t address) {
+    const DebugLabel* label = debug.label_before(address);
+    if (!label) {
+        std::ostringstream text;
+        text << "0x" << std::hex << std::setw(4) << std::setfill('0') << address;
+        return text.str();
+    }
+    return "." + label->name + (label->address == address ? "" : "+" + std::to_string(address - label->address));
+}
+
+void append_cost(std::ostringstream& out, std::uint64_t cycles, std::uint64_t total) {
+    out << "  " << std::setw(10) << cycles << ' ' << std::setw(5) << std::fixed << std::setprecision(1)
+        << (total > 0 ? 100.0 * static_cast<double>(cycles) / static_cast<double>(total) : 0.0) << "%  ";
+}
+
+// the lines that took the most cycles first
+void sort_by_cycles(std::vector<LineCost>& costs) {
+    std::sort(costs.begin(), costs.end(), [](const LineCost& a, const LineCost& b) {
+        return a.cycles != b.cycles ? a.cycles > b.cycles : a.address < b.address;
+    });
+}
+}
+
+std::string profile_report(const Profile& profile, const DebugInfo& debug, const std::vector<std::uint16_t>& image,
+                           std::size_t max_lines) {
+    std::uint64_t total = 0;
+    for (std::uint64_t executed : profile.executed) {
+        total += executed;
+    }
+
+    // everything a line, or a call or ret on it, took. words the program
+    //  runs outside of itself, and the return stack, are counted apart
+    std::map<std::uint32_t, LineCost> lines;
+    std::map<std::uint32_t, LineCost> calls;
+    std::uint64_t                     runtime = 0, outside = 0;
+    // the ret of an inline call jumps to the jump back it stored there
+    const std::size_t return_jump = number_from_string(std::string_view(SUBR_PC_LOC).substr(2), 16);
+    const bool        has_ret     = std::any_of(debug.words.begin(), debug.words.end(), [](const WordDebugInfo& word) {
+        return word.kind == WordKind::Return;
+    });
+    for (std::size_t address = 0; address < profile.executed.size(); ++address) {
+        const std::uint64_t executed = profile.executed[address];
+        if (executed == 0) {
+            continue;
+        }
+        if (address >= debug.words.size()) {
+            (address == return_jump && has_ret ? runtime : outside) += executed;
+            continue;
+        }
+        const WordDebugInfo& word = debug.words[address];
+        if (word.kind == WordKind::Runtime) {
+            runtime += executed;
+            continue;
+        }
+        const bool overhead = word.kind == WordKind::Call || word.kind == WordKind::Return;
+        auto [it, inserted] = (overhead ? calls : lines).try_emplace(word.loc.line);
+        LineCost& cost      = it->second;
+        if (inserted) {
+            cost = LineCost { word.loc.line, static_cast<std::uint16_t>(address), 0, executed, word.kind };
+        }
+        cost.cycles += executed;
+    }
+
+    std::ostringstream out;
+    out << "profile of " << total << " cycles\n";
+    std::vector<LineCost> hot;
+    for (const auto& [line, cost] : lines) {
+        hot.push_back(cost);
+    }
+    sort_by_cycles(hot);
+    out << "  hottest lines:\n";
+    for (std::size_t i = 0; i < std::min(hot.size(), max_lines); ++i) {
+        append_cost(out, hot[i].cycles, total);
+        out << "line " << hot[i].line << ", " << where(debug, hot[i].address) << "\n";
+    }
+
+    std::vector<LineCost> overhead;
+    std::uint64_t         overhead_cycles = runtime;
+    for (const auto& [line, cost] : calls) {
+        overhead.push_back(cost);
+        overhead_cycles += cost.cycles;
+    }
+    if (overhead_cycles > 0) {
+        sort_by_cycles(overhead);
+        out << "  calls and returns, " << overhead_cycles << " cycles:\n";
+        for (std::size_t i = 0; i < std::min(overhead.size(), max_lines); ++i) {
+            append_cost(out, overhead[i].cycles, total);
+            out << "line " << overhead[i].line << ", " << (overhead[i].kind == WordKind::Call ? "call" : "ret") << " at "
+                << where(debug, overhead[i].address) << ", " << overhead[i].times << " times\n";
+        }
+        if (runtime > 0) {
+            append_cost(out, runtime, total);
+            out << "return jumps and the routines of the return stack\n";
+        }
+    }
+    if (outside > 0) {
+        out << "  outside the program:\n";
+        append_cost(out, outside, total);
+        out << "words that aren't part of the program\n";
+    }
+
+    // conditional jumps of the program, the ones that ran most first
+    std::vector<std::size_t> jumps;
+    for (std::size_t address = 0; address < std::min(image.size(), debug.words.size()); ++address) {
+        const auto opcode = static_cast<Instr>(image[address] >> 12);
+        if ((opcode == Instr::JGE || opcode == Instr::JNE) && debug.words[address].kind == WordKind::Code
+            && address < profile.executed.size() && profile.executed[address] > 0) {
+            jumps.push_back(address);
+        }
+    }
+    std::sort(jumps.begin(), jumps.end(), [&](std::size_t a, std::size_t b) {
+        return profile.executed[a] != profile.executed[b] ? profile.executed[a] > profile.executed[b] : a < b;
+    });
+    if (!jumps.empty()) {
+        out << "  conditional jumps:\n";
+    }
+    for (std::size_t i = 0; i < std::min(jumps.size(), max_lines); ++i) {
+        const std::size_t address = jumps[i];
+        out << "    line " << debug.words[address].loc.line << ", " << where(debug, static_cast<std::uint16_t>(address)) << ": "
+            << name_from_instr(static_cast<Instr>(image[address] >> 12)) << " jumped " << profile.taken[address] << " of "
+            << profile.executed[address] << " times\n";
+    }
+    return out.str();
+}
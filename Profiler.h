@@ -0,0 +1,18 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uint...
+#include <string>  // std::string
+#include <vector>  // std::vector
+#include "DebugInfo.h"
+#include "Machine.h"
+
+// where the cycles of a profiled run of image went: the source lines that
+// took the most, then what calls, rets and the code they run besides the
+// subroutine took, then how often the conditional jumps that ran jumped.
+// at most max_lines lines for each
+std::string profile_report(const Profile& profile, const DebugInfo& debug, const std::vector<std::uint16_t>& image,
+                           std::size_t max_lines = 10);
+
+#endif // PROFILER_H
@@ -0,0 +1,159 @@
+#include "Program.h"
+
+#include <utility> // std::move
+
+static constexpr std::size_t INITIAL_SLOTS = 64;
+
+Program::Program() {
+    clear();
+}
+
+std::uint32_t Program::hash_of(std::string_view text) {
+    // FNV-1a, like SymbolTable
+    std::uint32_t hash = 2166136261u;
+    for (char c : text) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+arg_id_t Program::intern(std::string_view text) {
+    if (text.empty()) {
+        return NO_ARG;
+    }
+    if ((m_texts.size() + 1) * 2 > m_slots.size()) {
+        grow();
+    }
+    const std::uint32_t hash = hash_of(text);
+    const std::size_t   mask = m_slots.size() - 1;
+    std::size_t         i    = hash & mask;
+    // linear probing, the index is never more than half full so this terminates
+    for (; m_slots[i].id != NO_ARG; i = (i + 1) & mask) {
+        if (m_slots[i].hash == hash && this->text(m_slots[i].id) == text) {
+            return m_slots[i].id;
+        }
+    }
+    const auto id = static_cast<arg_id_t>(m_texts.size());
+    m_slots[i]    = Slot { hash, id };
+    m_texts.push_back(m_arena.store_counted(text));
+    return id;
+}
+
+arg_id_t Program::intern(std::initializer_list<std::string_view> parts) {
+    m_scratch.clear();
+    for (std::string_view part : parts) {
+        m_scratch += part;
+    }
+    return intern(std::string_view(m_scratch));
+}
+
+void Program::push_back(Instr instr, arg_id_t arg, source_location_t loc, bool executed) {
+    m_instrs.push_back(instr);
+    m_args.push_back(arg);
+    m_locs.push_back(loc);
+    m_executed.push_back(executed);
+}
+
+void Program::reserve(std::size_t size) {
+    m_instrs.reserve(size);
+    m_args.reserve(size);
+    m_locs.reserve(size);
+    m_executed.reserve(size);
+}
+
+void Program::resize(std::size_t size) {
+    m_instrs.resize(size);
+    m_args.resize(size);
+    m_locs.resize(size);
+    m_executed.resize(size);
+}
+
+void Program::clear() {
+    resize(0);
+    m_arena.clear();
+    // the empty text is always there, as NO_ARG, and never in the index
+    m_texts.assign(1, m_arena.store_counted(std::string_view()));
+    m_slots.assign(INITIAL_SLOTS, Slot { 0, NO_ARG });
+}
+
+void Program::shift_lines(std::size_t first, std::size_t last, std::uint32_t delta) {
+    for (std::size_t i = first; i < last; ++i) {
+        m_locs[i].line += delta;
+    }
+}
+
+void Program::remove(const std::vector<bool>& marked) {
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < size(); ++i) {
+        if (!marked[i]) {
+            m_instrs[kept]   = m_instrs[i];
+            m_args[kept]     = m_args[i];
+            m_locs[kept]     = m_locs[i];
+            m_executed[kept] = m_executed[i];
+            ++kept;
+        }
+    }
+    resize(kept);
+}
+
+void Program::erase(std::size_t first, std::size_t last) {
+    const auto from = static_cast<std::ptrdiff_t>(first);
+    const auto to   = static_cast<std::ptrdiff_t>(last);
+    m_instrs.erase(m_instrs.begin() + from, m_instrs.begin() + to);
+    m_args.erase(m_args.begin() + from, m_args.begin() + to);
+    m_locs.erase(m_locs.begin() + from, m_locs.begin() + to);
+    m_executed.erase(m_executed.begin() + from, m_executed.begin() + to);
+}
+
+void Program::select(const std::vector<std::size_t>& rows) {
+    std::vector<Instr>             instrs;
+    std::vector<arg_id_t>          args;
+    std::vector<source_location_t> locs;
+    std::vector<bool>              executed;
+    instrs.reserve(rows.size());
+    args.reserve(rows.size());
+    locs.reserve(rows.size());
+    executed.reserve(rows.size());
+    for (std::size_t row : rows) {
+        instrs.push_back(m_instrs[row]);
+        args.push_back(m_args[row]);
+        locs.push_back(m_locs[row]);
+        executed.push_back(m_executed[row]);
+    }
+    m_instrs   = std::move(instrs);
+    m_args     = std::move(args);
+    m_locs     = std::move(locs);
+    m_executed = std::move(executed);
+}
+
+void Program::insert(std::size_t at, const Program& other) {
+    // every text of other is interned once, not once for every row using it
+    std::vector<arg_id_t> ids(other.m_texts.size(), NO_ARG);
+    for (arg_id_t id = 1; id < other.m_texts.size(); ++id) {
+        ids[id] = intern(other.text(id));
+    }
+    const auto pos = static_cast<std::ptrdiff_t>(at);
+    m_instrs.insert(m_instrs.begin() + pos, other.m_instrs.begin(), other.m_instrs.end());
+    m_locs.insert(m_locs.begin() + pos, other.m_locs.begin(), other.m_locs.end());
+    m_executed.insert(m_executed.begin() + pos, other.m_executed.begin(), other.m_executed.end());
+    m_args.insert(m_args.begin() + pos, other.m_args.size(), NO_ARG);
+    for (std::size_t i = 0; i < other.m_args.size(); ++i) {
+        m_args[at + i] = ids[other.m_args[i]];
+    }
+}
+
+void Program::grow() {
+    std::vector<Slot> slots(m_slots.size() * 2, Slot { 0, NO_ARG });
+    const std::size_t mask = slots.size() - 1;
+    for (const Slot& slot : m_slots) {
+        if (slot.id == NO_ARG)
+            continue;
+        std::size_t i = slot.hash & mask;
+        while (slots[i].id != NO_ARG) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = slot;
+    }
+    m_slots = std::move(slots);
+}
@@ -0,0 +1,128 @@
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include <cstddef>          // std::size_t
+#include <cstdint>          // std::uint...
+#include <initializer_list> // std::initializer_list
+#include <string>           // std::string
+#include <string_view>      // std::string_view
+#include <vector>           // std::vector
+#include "arch.h"
+#include "StringArena.h"
+
+// index of an argument's text in a Program. the same text always gets the
+//  same id, so arguments are compared by comparing their ids
+using arg_id_t = std::uint32_t;
+
+// the empty argument, of instructions that don't take one
+static constexpr arg_id_t NO_ARG = 0;
+
+// the program before it's encoded, one row per word of memory. every column
+// is an array of its own, so a pass that only looks at the instructions
+// doesn't drag the arguments and locations through the cache with them.
+//
+// the text of every argument is interned into one arena, which includes the
+// arguments the parser generates itself. nothing points into the source, so
+// the source may change or go away once it's lexed.
+class Program
+{
+public:
+    Program();
+
+    std::size_t size() const {
+        return m_instrs.size();
+    }
+    bool empty() const {
+        return m_instrs.empty();
+    }
+
+    Instr instr(std::size_t i) const {
+        return m_instrs[i];
+    }
+    arg_id_t arg_id(std::size_t i) const {
+        return m_args[i];
+    }
+    std::string_view arg(std::size_t i) const {
+        return text(m_args[i]);
+    }
+    source_location_t loc(std::size_t i) const {
+        return m_locs[i];
+    }
+    // declared with `dx`
+    bool executed(std::size_t i) const {
+        return m_executed[i];
+    }
+    // the text of an id, which stays where it is until the program is cleared
+    std::string_view text(arg_id_t id) const {
+        return m_arena.counted(m_texts[id]);
+    }
+
+    // the columns themselves
+    const std::vector<Instr>& instrs() const {
+        return m_instrs;
+    }
+    const std::vector<source_location_t>& locs() const {
+        return m_locs;
+    }
+
+    void set_instr(std::size_t i, Instr instr) {
+        m_instrs[i] = instr;
+    }
+    void set_arg(std::size_t i, arg_id_t arg) {
+        m_args[i] = arg;
+    }
+    void set_arg(std::size_t i, std::string_view text) {
+        m_args[i] = intern(text);
+    }
+
+    // the id of text, storing it if it's new
+    arg_id_t intern(std::string_view text);
+    // the same, for the parts one after the other as one text
+    arg_id_t intern(std::initializer_list<std::string_view> parts);
+
+    void push_back(Instr instr, arg_id_t arg, source_location_t loc, bool executed = false);
+    void push_back(Instr instr, std::string_view arg, source_location_t loc, bool executed = false) {
+        push_back(instr, intern(arg), loc, executed);
+    }
+    void reserve(std::size_t size);
+    // drops the rows from size on, their texts stay
+    void resize(std::size_t size);
+    // drops all rows and texts
+    void clear();
+    // adds delta to the lines of the rows [first, last)
+    void shift_lines(std::size_t first, std::size_t last, std::uint32_t delta);
+
+    // removes the marked rows, the others keep their order
+    void remove(const std::vector<bool>& marked);
+    // removes the rows [first, last)
+    void erase(std::size_t first, std::size_t last);
+    // the rows become the ones listed, in that order. a row may be listed
+    //  more than once
+    void select(const std::vector<std::size_t>& rows);
+    // inserts all rows of other before row at, with their texts interned here
+    void insert(std::size_t at, const Program& other);
+
+private:
+    struct Slot {
+        std::uint32_t hash;
+        arg_id_t      id;
+    };
+
+    static std::uint32_t hash_of(std::string_view text);
+    void                 grow();
+
+    std::vector<Instr>             m_instrs;
+    std::vector<arg_id_t>          m_args;
+    std::vector<source_location_t> m_locs;
+    std::vector<bool>              m_executed;
+    // where in m_arena the text of every id is, and an open-addressing hash
+    //  index of them. a position takes a quarter of a view, which adds up
+    //  as every call has texts of its own
+    std::vector<std::uint32_t> m_texts;
+    std::vector<Slot>          m_slots;
+    StringArena                m_arena;
+    // where intern(parts) puts the parts together
+    std::string m_scratch;
+};
+
+#endif // PROGRAM_H
@@ -0,0 +1,88 @@
+#include "Stats.h"
+
+#include <iomanip> // std::setw, std::fixed, std::setprecision
+#include <sstream> // std::ostringstream
+
+const char* name_from_stat_counter(StatCounter counter) {
+    switch (counter) {
+    case StatCounter::SourceLines:
+        return "source_lines";
+    case StatCounter::InstructionsEmitted:
+        return "instructions_emitted";
+    case StatCounter::CallExpansions:
+        return "call_expansions";
+    case StatCounter::SymbolLookups:
+        return "symbol_lookups";
+    case StatCounter::HeapAllocations:
+        return "heap_allocations";
+    case StatCounter::Count:
+        break;
+    }
+    return "unknown";
+}
+
+const char* name_from_stat_phase(StatPhase phase) {
+    switch (phase) {
+    case StatPhase::Parse:
+        return "parse";
+    case StatPhase::Transform:
+        return "transform";
+    case StatPhase::Encode:
+        return "encode";
+    case StatPhase::Listing:
+        return "listing";
+    case StatPhase::Write:
+        return "write";
+    case StatPhase::Run:
+        return "run";
+    case StatPhase::Count:
+        break;
+    }
+    return "unknown";
+}
+
+StatsSnapshot stats_snapshot() {
+    StatsSnapshot snapshot;
+#ifndef MU0ASM_NO_STATS
+    for (std::size_t i = 0; i < snapshot.counters.size(); ++i) {
+        snapshot.counters[i] = stats_detail::g_counters[i].load(std::memory_order_relaxed);
+    }
+    for (std::size_t i = 0; i < snapshot.phases.size(); ++i) {
+        snapshot.phases[i].nanoseconds = stats_detail::g_phase_nanoseconds[i].load(std::memory_order_relaxed);
+        snapshot.phases[i].entered     = stats_detail::g_phase_entered[i].load(std::memory_order_relaxed);
+    }
+#endif
+    return snapshot;
+}
+
+std::string StatsSnapshot::to_text() const {
+    std::ostringstream out;
+    out << "stats:\n";
+    for (std::size_t i = 0; i < phases.size(); ++i) {
+        out << "  " << std::left << std::setw(22) << name_from_stat_phase(static_cast<StatPhase>(i)) << std::right
+            << std::setw(12) << std::fixed << std::setprecision(3) << static_cast<double>(phases[i].nanoseconds) / 1e6
+            << " ms, " << phases[i].entered << " times\n";
+    }
+    for (std::size_t i = 0; i < counters.size(); ++i) {
+        out << "  " << std::left << std::setw(22) << name_from_stat_counter(static_cast<StatCounter>(i)) << std::right
+            << std::setw(12) << counters[i] << "\n";
+    }
+    return out.str();
+}
+
+std::string StatsSnapshot::to_json() const {
+    // the names need no escaping
+    std::ostringstream out;
+    out << "{\n  \"phases\": {";
+    for (std::size_t i = 0; i < phases.size(); ++i) {
+        out << (i == 0 ? "\n" : ",\n") << "    \"" << name_from_stat_phase(static_cast<StatPhase>(i))
+            << "\": { \"nanoseconds\": " << phases[i].nanoseconds << ", \"entered\": " << phases[i].entered << " }";
+    }
+    out << "\n  },\n  \"counters\": {";
+    for (std::size_t i = 0; i < counters.size(); ++i) {
+        out << (i == 0 ? "\n" : ",\n") << "    \"" << name_from_stat_counter(static_cast<StatCounter>(i))
+            << "\": " << counters[i];
+    }
+    out << "\n  }\n}\n";
+    return out.str();
+}
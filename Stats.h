@@ -0,0 +1,133 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <array>   // std::array
+#include <atomic>  // std::atomic
+#include <chrono>  // std::chrono
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uint...
+#include <string>  // std::string
+
+// counters and phase timers of everything this process assembles, for
+// --stats. nothing is recorded until enable_stats is called, until then a
+// counter or timer is a single predictable branch. with MU0ASM_NO_STATS
+// defined they compile to nothing at all.
+
+enum class StatCounter : std::uint8_t
+{
+    // lines of source parsed, including empty ones and comments
+    SourceLines,
+    // words encoded, every word of the image is one
+    InstructionsEmitted,
+    CallExpansions,
+    // lookups of `$` and `.` names in a symbol table
+    SymbolLookups,
+    // operator new, only counted by programs that replace it
+    HeapAllocations,
+    Count,
+};
+
+enum class StatPhase : std::uint8_t
+{
+    // reading the source into pairs, the constructor of the parser
+    Parse,
+    // dead code, moving data, merging constants, inlining, superoptimizing
+    //  and the peephole rules
+    Transform,
+    // parse_all, defining data and encoding
+    Encode,
+    // the listing, its annotations and the debug info
+    Listing,
+    // writing the output files
+    Write,
+    Run,
+    Count,
+};
+
+const char* name_from_stat_counter(StatCounter counter);
+const char* name_from_stat_phase(StatPhase phase);
+
+struct PhaseStats {
+    // summed over every thread that went through the phase
+    std::uint64_t nanoseconds = 0;
+    std::uint64_t entered     = 0;
+};
+
+struct StatsSnapshot {
+    std::array<std::uint64_t, static_cast<std::size_t>(StatCounter::Count)> counters {};
+    std::array<PhaseStats, static_cast<std::size_t>(StatPhase::Count)>      phases {};
+
+    std::string to_text() const;
+    std::string to_json() const;
+};
+
+#ifdef MU0ASM_NO_STATS
+inline void enable_stats() {
+}
+constexpr bool stats_enabled() {
+    return false;
+}
+#else
+namespace stats_detail {
+// set once before any assembling starts, read-only afterwards
+inline bool                       g_enabled = false;
+inline std::atomic<std::uint64_t> g_counters[static_cast<std::size_t>(StatCounter::Count)] {};
+inline std::atomic<std::uint64_t> g_phase_nanoseconds[static_cast<std::size_t>(StatPhase::Count)] {};
+inline std::atomic<std::uint64_t> g_phase_entered[static_cast<std::size_t>(StatPhase::Count)] {};
+}
+
+// has to be called before any threads assemble anything
+inline void enable_stats() {
+    stats_detail::g_enabled = true;
+}
+inline bool stats_enabled() {
+    return stats_detail::g_enabled;
+}
+#endif
+
+inline void add_stat([[maybe_unused]] StatCounter counter, [[maybe_unused]] std::uint64_t amount = 1) {
+#ifndef MU0ASM_NO_STATS
+    if (stats_detail::g_enabled) {
+        stats_detail::g_counters[static_cast<std::size_t>(counter)].fetch_add(amount, std::memory_order_relaxed);
+    }
+#endif
+}
+
+// adds the time from its construction to its destruction to phase
+class PhaseTimer
+{
+public:
+    explicit PhaseTimer([[maybe_unused]] StatPhase phase) {
+#ifndef MU0ASM_NO_STATS
+        if (stats_detail::g_enabled) {
+            m_phase = phase;
+            m_start = std::chrono::steady_clock::now();
+        }
+#endif
+    }
+    ~PhaseTimer() {
+#ifndef MU0ASM_NO_STATS
+        if (m_phase != StatPhase::Count) {
+            const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start);
+            const auto i       = static_cast<std::size_t>(m_phase);
+            stats_detail::g_phase_nanoseconds[i].fetch_add(static_cast<std::uint64_t>(elapsed.count()), std::memory_order_relaxed);
+            stats_detail::g_phase_entered[i].fetch_add(1, std::memory_order_relaxed);
+        }
+#endif
+    }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+#ifndef MU0ASM_NO_STATS
+    // Count while not timing anything
+    StatPhase                             m_phase = StatPhase::Count;
+    std::chrono::steady_clock::time_point m_start;
+#endif
+};
+
+// what was recorded so far, all zero unless stats are enabled
+StatsSnapshot stats_snapshot();
+
+#endif // STATS_H
@@ -0,0 +1,78 @@
+#include "StringArena.h"
+
+#include <cstring> // std::memcpy
+
+// strings longer than this get a block of their own
+static constexpr std::size_t BLOCK_BITS = 12;
+static constexpr std::size_t BLOCK_SIZE = std::size_t { 1 } << BLOCK_BITS;
+// sizes of counted strings from this on take 4 more bytes after it
+static constexpr unsigned char LONG_SIZE = 0xff;
+
+std::string_view StringArena::store(std::initializer_list<std::string_view> parts) {
+    std::size_t size = 0;
+    for (std::string_view part : parts) {
+        size += part.size();
+    }
+    char* dest = at(allocate(size));
+    char* end  = dest;
+    for (std::string_view part : parts) {
+        if (!part.empty()) {
+            std::memcpy(end, part.data(), part.size());
+            end += part.size();
+        }
+    }
+    return std::string_view(dest, size);
+}
+
+std::uint32_t StringArena::store_counted(std::string_view text) {
+    const bool          is_long  = text.size() >= LONG_SIZE;
+    const std::size_t   prefix   = is_long ? 1 + sizeof(std::uint32_t) : 1;
+    const std::uint32_t position = allocate(prefix + text.size());
+    char*               dest     = at(position);
+    dest[0]                      = static_cast<char>(is_long ? LONG_SIZE : text.size());
+    if (is_long) {
+        const auto size = static_cast<std::uint32_t>(text.size());
+        std::memcpy(dest + 1, &size, sizeof(size));
+    }
+    if (!text.empty()) {
+        std::memcpy(dest + prefix, text.data(), text.size());
+    }
+    return position;
+}
+
+std::string_view StringArena::counted(std::uint32_t position) const {
+    const char* text = at(position);
+    std::size_t size = static_cast<unsigned char>(text[0]);
+    if (size != LONG_SIZE) {
+        return std::string_view(text + 1, size);
+    }
+    std::uint32_t long_size = 0;
+    std::memcpy(&long_size, text + 1, sizeof(long_size));
+    return std::string_view(text + 1 + sizeof(long_size), long_size);
+}
+
+void StringArena::clear() {
+    m_blocks.clear();
+    m_current    = 0;
+    m_block_used = 0;
+}
+
+std::uint32_t StringArena::allocate(std::size_t size) {
+    if (size > BLOCK_SIZE) {
+        // gets a block of its own, the one being filled stays the same
+        m_blocks.emplace_back(new char[size]);
+        return static_cast<std::uint32_t>((m_blocks.size() - 1) << BLOCK_BITS);
+    }
+    if (m_blocks.empty() || m_block_used + size > BLOCK_SIZE) {
+        m_blocks.emplace_back(new char[BLOCK_SIZE]);
+        m_current    = m_blocks.size() - 1;
+        m_block_used = 0;
+    }
+    const auto position = static_cast<std::uint32_t>(m_current << BLOCK_BITS | m_block_used);
+    m_block_used += size;
+    return position;
+}
+
+char* StringArena::at(std::uint32_t position) const {
+    return m_blocks[position >> BLOCK_BITS].get() + (position & (BLOCK_SIZE - 1));
+}
@@ -0,0 +1,41 @@
+#ifndef STRINGARENA_H
+#define STRINGARENA_H
+
+#include <cstddef>          // std::size_t
+#include <cstdint>          // std::uint32_t
+#include <initializer_list> // std::initializer_list
+#include <memory>           // std::unique_ptr
+#include <string_view>      // std::string_view
+#include <vector>           // std::vector
+
+// copies of strings that never move until the arena is cleared. they are
+// packed into fixed-size blocks, so storing one rarely allocates.
+class StringArena
+{
+public:
+    std::string_view store(std::string_view text) {
+        return store({ text });
+    }
+    // stores the parts one after the other, as one string
+    std::string_view store(std::initializer_list<std::string_view> parts);
+    // stores text after its size, and returns where it is in 4 bytes
+    //  instead of the 16 of a view, for keeping many of them
+    std::uint32_t store_counted(std::string_view text);
+    // the text store_counted stored at position
+    std::string_view counted(std::uint32_t position) const;
+    void             clear();
+
+private:
+    // where size chars that stay where they are start, as the index of
+    //  their block shifted up by the bits of an offset into a block, and
+    //  the offset
+    std::uint32_t allocate(std::size_t size);
+    char*         at(std::uint32_t position) const;
+
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    // the block that's being filled, and how much of it is
+    std::size_t m_current    = 0;
+    std::size_t m_block_used = 0;
+};
+
+#endif // STRINGARENA_H
@@ -0,0 +1,264 @@
+#include "Superopt.h"
+
+#include <algorithm>     // std::sort
+#include <array>         // std::array
+#include <cstdio>        // FILE, fopen, ...
+#include <cstring>       // std::memcmp
+#include <unordered_set> // std::unordered_set
+
+#include "utility.h"
+
+namespace {
+// what every value is, as coefficients of the values ACC and the words had
+//  at the start. row 0 is ACC, row i + 1 the word with operand i, and
+//  column 0 is the ACC at the start, column i + 1 the word
+constexpr std::size_t ROWS = SUPEROPT_MAX_OPERANDS + 1;
+
+struct State {
+    std::array<std::uint16_t, ROWS * ROWS> coefficients {};
+
+    bool operator==(const State& other) const {
+        return std::memcmp(coefficients.data(), other.coefficients.data(), sizeof(coefficients)) == 0;
+    }
+};
+
+struct StateHash {
+    std::size_t operator()(const State& state) const {
+        std::uint64_t h = 0x9e3779b97f4a7c15;
+        for (std::uint16_t c : state.coefficients) {
+            h = (h ^ c) * 0xff51afd7ed558ccd;
+            h ^= h >> 29;
+        }
+        return static_cast<std::size_t>(h);
+    }
+};
+
+State start_state(std::size_t operand_count) {
+    State state;
+    for (std::size_t i = 0; i <= operand_count; ++i) {
+        state.coefficients[i * ROWS + i] = 1;
+    }
+    return state;
+}
+
+void apply(State& state, SeqInstr instr) {
+    std::uint16_t*       acc  = &state.coefficients[0];
+    std::uint16_t*       word = &state.coefficients[(instr.operand + 1u) * ROWS];
+    switch (instr.instr) {
+    case Instr::LDA:
+        std::copy(word, word + ROWS, acc);
+        break;
+    case Instr::STO:
+        std::copy(acc, acc + ROWS, word);
+        break;
+    case Instr::ADD:
+        for (std::size_t i = 0; i < ROWS; ++i)
+            acc[i] = static_cast<std::uint16_t>(acc[i] + word[i]);
+        break;
+    case Instr::SUB:
+        for (std::size_t i = 0; i < ROWS; ++i)
+            acc[i] = static_cast<std::uint16_t>(acc[i] - word[i]);
+        break;
+    default:
+        break;
+    }
+}
+
+State run(const Sequence& sequence, std::size_t operand_count) {
+    State state = start_state(operand_count);
+    for (SeqInstr instr : sequence) {
+        apply(state, instr);
+    }
+    return state;
+}
+
+bool is_straight_line(const Sequence& sequence, std::size_t operand_count) {
+    return operand_count <= SUPEROPT_MAX_OPERANDS && std::all_of(sequence.begin(), sequence.end(), [&](SeqInstr instr) {
+        return instr.operand < operand_count
+            && (instr.instr == Instr::LDA || instr.instr == Instr::STO || instr.instr == Instr::ADD || instr.instr == Instr::SUB);
+    });
+}
+}
+
+bool sequences_equivalent(const Sequence& a, const Sequence& b, std::size_t operand_count) {
+    return is_straight_line(a, operand_count) && is_straight_line(b, operand_count)
+        && run(a, operand_count) == run(b, operand_count);
+}
+
+Sequence superoptimize(const Sequence& sequence, std::size_t operand_count, std::size_t max_states) {
+    if (sequence.empty() || !is_straight_line(sequence, operand_count)) {
+        return sequence;
+    }
+    const State target = run(sequence, operand_count);
+
+    // every state is reached by the instruction from its parent, the first
+    //  time it's reached is with the fewest instructions
+    struct Node {
+        State       state;
+        std::size_t parent;
+        SeqInstr    instr;
+    };
+    std::vector<Node>                    nodes { Node { start_state(operand_count), 0, SeqInstr { Instr::LDA, 0 } } };
+    std::unordered_set<State, StateHash> seen { nodes[0].state };
+    auto                                 path_to = [&](std::size_t node) {
+        Sequence result;
+        for (; node != 0; node = nodes[node].parent) {
+            result.push_back(nodes[node].instr);
+        }
+        std::reverse(result.begin(), result.end());
+        return result;
+    };
+    if (nodes[0].state == target) {
+        return {};
+    }
+
+    std::size_t level_begin = 0;
+    for (std::size_t length = 1; length < sequence.size(); ++length) {
+        const std::size_t level_end = nodes.size();
+        for (std::size_t node = level_begin; node < level_end; ++node) {
+            for (Instr instr : { Instr::LDA, Instr::STO, Instr::ADD, Instr::SUB }) {
+                for (std::size_t operand = 0; operand < operand_count; ++operand) {
+                    const SeqInstr next { instr, static_cast<std::uint8_t>(operand) };
+                    State          state = nodes[node].state;
+                    apply(state, next);
+                    if (!seen.insert(state).second) {
+                        continue;
+                    }
+                    nodes.push_back(Node { state, node, next });
+                    if (state == target) {
+                        return path_to(nodes.size() - 1);
+                    }
+                    if (nodes.size() >= max_states) {
+                        return sequence;
+                    }
+                }
+            }
+        }
+        level_begin = level_end;
+    }
+    return sequence;
+}
+
+std::string sequence_to_string(const Sequence& sequence) {
+    std::string result;
+    for (SeqInstr instr : sequence) {
+        if (!result.empty()) {
+            result += ", ";
+        }
+        result += name_from_instr(instr.instr);
+        result += ' ';
+        result += std::to_string(instr.operand);
+    }
+    return result;
+}
+
+bool sequence_from_string(std::string_view text, Sequence& sequence) {
+    sequence.clear();
+    text = trim_whitespace(text);
+    while (!text.empty()) {
+        const std::size_t      end   = std::min(text.find(','), text.size());
+        const std::string_view instr = trim_whitespace(text.substr(0, end));
+        const std::size_t      space = instr.find(' ');
+        if (space == std::string_view::npos) {
+            return false;
+        }
+        const std::string_view operand = trim_whitespace(instr.substr(space + 1));
+        if (operand.empty() || !std::all_of(operand.begin(), operand.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            return false;
+        }
+        sequence.push_back(SeqInstr { instr_from_name(instr.substr(0, space)), static_cast<std::uint8_t>(number_from_string(operand, 10)) });
+        text = end < text.size() ? trim_whitespace(text.substr(end + 1)) : std::string_view {};
+    }
+    return true;
+}
+
+bool SuperoptDatabase::load(const std::string& path) {
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp) {
+        return true;
+    }
+    std::string contents;
+    char        buffer[4096];
+    std::size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+        contents.append(buffer, n);
+    }
+    const bool ok = !ferror(fp);
+    fclose(fp);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::string_view            rest = contents;
+    while (!rest.empty()) {
+        const std::size_t      end  = std::min(rest.find('\n'), rest.size());
+        const std::string_view line = trim_whitespace(rest.substr(0, end));
+        rest                        = end < rest.size() ? rest.substr(end + 1) : std::string_view {};
+        // lines that don't make sense are skipped, find checks the rest
+        const std::size_t arrow = line.find("->");
+        if (line.empty() || line.front() == '#' || arrow == std::string_view::npos) {
+            continue;
+        }
+        m_rewrites[std::string(trim_whitespace(line.substr(0, arrow)))] = std::string(trim_whitespace(line.substr(arrow + 2)));
+    }
+    return ok;
+}
+
+bool SuperoptDatabase::save(const std::string& path) const {
+    std::vector<std::string> lines;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& [from, to] : m_rewrites) {
+            lines.push_back(from + " -> " + to);
+        }
+    }
+    // sorted, so the file only changes where rewrites were added
+    std::sort(lines.begin(), lines.end());
+    const std::string tmp_path = path + ".tmp";
+    FILE*             fp       = fopen(tmp_path.c_str(), "wb");
+    if (!fp) {
+        return false;
+    }
+    bool ok = fputs("# rewrites found by mu0asm --superopt, 'from -> to'\n", fp) >= 0;
+    for (const std::string& line : lines) {
+        ok = ok && fputs(line.c_str(), fp) >= 0 && fputc('\n', fp) != EOF;
+    }
+    ok = fclose(fp) == 0 && ok;
+    // rename is atomic, readers see either the old file or the complete new one
+    if (!ok || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool SuperoptDatabase::find(const Sequence& from, std::size_t operand_count, Sequence& to) const {
+    std::string text;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto                        it = m_rewrites.find(sequence_to_string(from));
+        if (it == m_rewrites.end()) {
+            return false;
+        }
+        text = it->second;
+    }
+    return sequence_from_string(text, to) && to.size() <= from.size() && sequences_equivalent(from, to, operand_count);
+}
+
+void SuperoptDatabase::insert(const Sequence& from, const Sequence& to) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto [it, inserted] = m_rewrites.emplace(sequence_to_string(from), sequence_to_string(to));
+    if (!inserted && it->second != sequence_to_string(to)) {
+        it->second = sequence_to_string(to);
+        inserted   = true;
+    }
+    m_changed = m_changed || inserted;
+}
+
+bool SuperoptDatabase::changed() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_changed;
+}
+
+std::size_t SuperoptDatabase::size() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_rewrites.size();
+}
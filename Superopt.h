@@ -0,0 +1,70 @@
+#ifndef SUPEROPT_H
+#define SUPEROPT_H
+
+#include <cstddef>       // std::size_t
+#include <cstdint>       // std::uint...
+#include <mutex>         // std::mutex
+#include <string>        // std::string
+#include <string_view>   // std::string_view
+#include <unordered_map> // std::unordered_map
+#include <vector>        // std::vector
+#include "arch.h"
+
+// an instruction of a straight-line run of LDA, STO, ADD and SUB. the
+// operand is the index of the word in the run's own list of words, in the
+// order they first appear, so runs that only differ in which words they
+// use look the same.
+struct SeqInstr {
+    Instr        instr;
+    std::uint8_t operand;
+
+    bool operator==(const SeqInstr&) const = default;
+};
+
+using Sequence = std::vector<SeqInstr>;
+
+// runs with more words than this aren't searched
+static constexpr std::size_t SUPEROPT_MAX_OPERANDS = 6;
+
+// true if a and b leave ACC and every word they use with the same value,
+// for every value ACC and those words could start with. everything these
+// instructions do is adding and subtracting modulo 2^16, so each value a
+// run leaves is a sum of the values it started with times a coefficient,
+// and two runs are the same if all of their coefficients are
+bool sequences_equivalent(const Sequence& a, const Sequence& b, std::size_t operand_count);
+
+// the shortest sequence equivalent to sequence, searching breadth first
+// through at most max_states different machine states. returns sequence
+// itself if nothing shorter was found
+Sequence superoptimize(const Sequence& sequence, std::size_t operand_count, std::size_t max_states = 1 << 18);
+
+// 'lda 0, add 1' and back
+std::string sequence_to_string(const Sequence& sequence);
+bool        sequence_from_string(std::string_view text, Sequence& sequence);
+
+// rewrites found by earlier searches, one per line as 'from -> to', where
+// to is the same as from if there is nothing shorter. rewrites read from
+// the file are checked again before they're used. safe to use from more
+// than one thread at once
+class SuperoptDatabase
+{
+public:
+    // a missing file is an empty database
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+
+    // false if the sequence isn't known
+    bool find(const Sequence& from, std::size_t operand_count, Sequence& to) const;
+    void insert(const Sequence& from, const Sequence& to);
+
+    // whether anything was inserted since it was loaded
+    bool changed() const;
+    std::size_t size() const;
+
+private:
+    mutable std::mutex                           m_mutex;
+    std::unordered_map<std::string, std::string> m_rewrites;
+    bool                                         m_changed = false;
+};
+
+#endif // SUPEROPT_H
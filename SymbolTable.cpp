@@ -0,0 +1,151 @@
+#include "SymbolTable.h"
+
+#include <utility> // std::move
+
+#include "Stats.h"
+
+static constexpr std::size_t INITIAL_SLOTS = 64;
+
+SymbolTable::SymbolTable()
+    : m_slots(INITIAL_SLOTS, Slot { 0, INVALID_SYMBOL }) {
+}
+
+std::uint32_t SymbolTable::hash_of(SymbolKind kind, std::string_view name) {
+    // FNV-1a, with the kind mixed in so both namespaces share one index
+    std::uint32_t hash = 2166136261u ^ static_cast<std::uint32_t>(kind);
+    for (char c : name) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+symbol_id_t SymbolTable::find(SymbolKind kind, std::string_view name) const {
+    add_stat(StatCounter::SymbolLookups);
+    const std::uint32_t hash = hash_of(kind, name);
+    const std::size_t   mask = m_slots.size() - 1;
+    // linear probing, the table is never more than half full so this terminates
+    for (std::size_t i = hash & mask;; i = (i + 1) & mask) {
+        const Slot& slot = m_slots[i];
+        if (slot.id == INVALID_SYMBOL) {
+            return INVALID_SYMBOL;
+        }
+        if (slot.hash == hash && slot.id != REMOVED_SYMBOL) {
+            const Symbol& sym = m_symbols[slot.id];
+            if (sym.kind == kind && sym.name == name) {
+                return slot.id;
+            }
+        }
+    }
+}
+
+symbol_id_t SymbolTable::define(SymbolKind kind, std::string_view name, std::uint32_t address, std::uint16_t value, std::uint32_t line) {
+    if ((m_used_slots + 1) * 2 > m_slots.size()) {
+        grow();
+    }
+    const std::uint32_t hash = hash_of(kind, name);
+    const std::size_t   mask = m_slots.size() - 1;
+    std::size_t         i    = hash & mask;
+    for (; m_slots[i].id != INVALID_SYMBOL; i = (i + 1) & mask) {
+        if (m_slots[i].id == REMOVED_SYMBOL)
+            continue;
+        const Symbol& sym = m_symbols[m_slots[i].id];
+        if (m_slots[i].hash == hash && sym.kind == kind && sym.name == name) {
+            return INVALID_SYMBOL;
+        }
+    }
+    auto id    = static_cast<symbol_id_t>(m_symbols.size());
+    m_slots[i] = Slot { hash, id };
+    ++m_used_slots;
+    m_symbols.push_back(Symbol { m_names.store(name), kind, address, value, line, INVALID_SYMBOL, false });
+    link_at_address(id);
+    return id;
+}
+
+symbol_id_t SymbolTable::find_at(SymbolKind kind, std::uint32_t address) const {
+    for (symbol_id_t id = first_at(address); id != INVALID_SYMBOL; id = m_symbols[id].next_at_address) {
+        if (m_symbols[id].kind == kind) {
+            return id;
+        }
+    }
+    return INVALID_SYMBOL;
+}
+
+void SymbolTable::set_address(symbol_id_t id, std::uint32_t address) {
+    unlink_at_address(id);
+    m_symbols[id].address = address;
+    link_at_address(id);
+}
+
+void SymbolTable::remove(symbol_id_t id) {
+    Symbol& sym = m_symbols[id];
+    if (sym.removed)
+        return;
+    const std::size_t mask = m_slots.size() - 1;
+    for (std::size_t i = hash_of(sym.kind, sym.name) & mask;; i = (i + 1) & mask) {
+        if (m_slots[i].id == id) {
+            // the slot stays used until the next grow, so probe chains through it stay intact
+            m_slots[i].id = REMOVED_SYMBOL;
+            break;
+        }
+    }
+    unlink_at_address(id);
+    sym.removed = true;
+}
+
+void SymbolTable::clear() {
+    m_symbols.clear();
+    m_used_slots = 0;
+    m_slots.assign(INITIAL_SLOTS, Slot { 0, INVALID_SYMBOL });
+    m_by_address.clear();
+    m_names.clear();
+}
+
+void SymbolTable::grow() {
+    // removed slots are dropped here, so only grow if the live ones need it
+    std::size_t live = 0;
+    for (const Slot& slot : m_slots) {
+        if (slot.id != INVALID_SYMBOL && slot.id != REMOVED_SYMBOL)
+            ++live;
+    }
+    std::size_t size = m_slots.size();
+    while ((live + 1) * 2 > size) {
+        size *= 2;
+    }
+    std::vector<Slot> slots(size, Slot { 0, INVALID_SYMBOL });
+    const std::size_t mask = slots.size() - 1;
+    m_used_slots           = live;
+    for (const Slot& slot : m_slots) {
+        if (slot.id == INVALID_SYMBOL || slot.id == REMOVED_SYMBOL)
+            continue;
+        std::size_t i = slot.hash & mask;
+        while (slots[i].id != INVALID_SYMBOL) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = slot;
+    }
+    m_slots = std::move(slots);
+}
+
+void SymbolTable::link_at_address(symbol_id_t id) {
+    Symbol& sym = m_symbols[id];
+    if (sym.address >= m_by_address.size()) {
+        m_by_address.resize(static_cast<std::size_t>(sym.address) + 1, INVALID_SYMBOL);
+    }
+    // keep symbols at one address in source order, which is the order of
+    //  definition unless symbols were moved or defined again later
+    symbol_id_t* link = &m_by_address[sym.address];
+    while (*link != INVALID_SYMBOL && m_symbols[*link].line <= sym.line) {
+        link = &m_symbols[*link].next_at_address;
+    }
+    sym.next_at_address = *link;
+    *link               = id;
+}
+
+void SymbolTable::unlink_at_address(symbol_id_t id) {
+    symbol_id_t* link = &m_by_address[m_symbols[id].address];
+    while (*link != id) {
+        link = &m_symbols[*link].next_at_address;
+    }
+    *link = m_symbols[id].next_at_address;
+}
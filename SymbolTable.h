@@ -0,0 +1,99 @@
+#ifndef SYMBOLTABLE_H
+#define SYMBOLTABLE_H
+
+#include <cstdint>     // std::uint...
+#include <string_view> // std::string_view
+#include <vector>      // std::vector
+#include "StringArena.h"
+
+// the two namespaces of names, `$name` for data and `.name` for labels
+enum class SymbolKind : std::uint8_t
+{
+    Data,
+    Label,
+};
+
+using symbol_id_t = std::uint32_t;
+
+static constexpr symbol_id_t INVALID_SYMBOL = 0xffffffff;
+// marks a hash slot whose symbol was removed, so probing continues past it
+static constexpr symbol_id_t REMOVED_SYMBOL = 0xfffffffe;
+
+struct Symbol {
+    // interned, stays valid for the lifetime of the table
+    std::string_view name;
+    SymbolKind       kind;
+    // index of the word in the program, which is its address as long as
+    //  the program fits into memory
+    std::uint32_t    address;
+    // only meaningful for data
+    std::uint16_t value;
+    // source line of the declaration, 0 for symbols the assembler made up
+    std::uint32_t line;
+    // next symbol at the same address, or INVALID_SYMBOL
+    symbol_id_t next_at_address;
+    // set once the symbol is removed, its id is never reused
+    bool removed;
+};
+
+// symbol table with interned names, an open-addressing hash index by
+// (kind, name) and a dense reverse index by address. every lookup is O(1).
+class SymbolTable
+{
+public:
+    SymbolTable();
+
+    // defines a new symbol. returns INVALID_SYMBOL if a symbol of the
+    //  same kind and name already exists.
+    symbol_id_t define(SymbolKind kind, std::string_view name, std::uint32_t address, std::uint16_t value = 0, std::uint32_t line = 0);
+    symbol_id_t find(SymbolKind kind, std::string_view name) const;
+
+    // first symbol of any kind at address, follow Symbol::next_at_address for the rest
+    symbol_id_t first_at(std::uint32_t address) const {
+        return address < m_by_address.size() ? m_by_address[address] : INVALID_SYMBOL;
+    }
+    // first symbol of the given kind at address
+    symbol_id_t find_at(SymbolKind kind, std::uint32_t address) const;
+
+    const Symbol& operator[](symbol_id_t id) const {
+        return m_symbols[id];
+    }
+    Symbol& operator[](symbol_id_t id) {
+        return m_symbols[id];
+    }
+    std::size_t size() const {
+        return m_symbols.size();
+    }
+    auto begin() const {
+        return m_symbols.begin();
+    }
+    auto end() const {
+        return m_symbols.end();
+    }
+
+    // moves a symbol to a new address, keeping the reverse index consistent
+    void set_address(symbol_id_t id, std::uint32_t address);
+    // makes the name free to be defined again. iteration still yields the
+    //  symbol, with Symbol::removed set
+    void remove(symbol_id_t id);
+    void clear();
+
+private:
+    struct Slot {
+        std::uint32_t hash;
+        symbol_id_t   id;
+    };
+
+    static std::uint32_t hash_of(SymbolKind kind, std::string_view name);
+    void                 grow();
+    void                 link_at_address(symbol_id_t id);
+    void                 unlink_at_address(symbol_id_t id);
+
+    std::vector<Symbol>      m_symbols;
+    std::vector<Slot>        m_slots;
+    std::size_t              m_used_slots = 0;
+    std::vector<symbol_id_t> m_by_address;
+    StringArena              m_names;
+};
+
+#endif // SYMBOLTABLE_H
@@ -0,0 +1,110 @@
+#include "ThreadPool.h"
+
+#include <utility> // std::move
+
+// index of the pool worker running on this thread, if any
+static thread_local const ThreadPool* t_pool  = nullptr;
+static thread_local std::size_t       t_index = 0;
+
+ThreadPool::ThreadPool(std::size_t thread_count) {
+    if (thread_count == 0) {
+        thread_count = std::thread::hardware_concurrency();
+    }
+    if (thread_count == 0) {
+        thread_count = 1;
+    }
+    for (std::size_t i = 0; i < thread_count; ++i) {
+        m_queues.push_back(std::make_unique<Queue>());
+    }
+    for (std::size_t i = 0; i < thread_count; ++i) {
+        m_threads.emplace_back(&ThreadPool::worker, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_work_cv.notify_all();
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::submit(Task task) {
+    std::size_t index;
+    if (t_pool == this) {
+        index = t_index;
+    } else {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        index  = m_next;
+        m_next = (m_next + 1) % m_queues.size();
+    }
+    // counted before it's queued, so a worker can never finish it before it's counted
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_queued;
+        ++m_pending;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+        m_queues[index]->tasks.push_back(std::move(task));
+    }
+    m_work_cv.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done_cv.wait(lock, [this] { return m_pending == 0; });
+}
+
+bool ThreadPool::try_pop(std::size_t index, Task& task) {
+    {
+        // newest task of our own first, it's the most likely to be warm in cache
+        Queue&                      own = *m_queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    // steal the oldest task of someone else
+    for (std::size_t i = 1; i < m_queues.size(); ++i) {
+        Queue&                      victim = *m_queues[(index + i) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::worker(std::size_t index) {
+    t_pool  = this;
+    t_index = index;
+    for (;;) {
+        Task task;
+        if (try_pop(index, task)) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                --m_queued;
+            }
+            task();
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_pending == 0) {
+                m_done_cv.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_work_cv.wait(lock, [this] { return m_stop || m_queued > 0; });
+        if (m_stop && m_queued == 0) {
+            return;
+        }
+    }
+}
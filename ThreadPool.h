@@ -0,0 +1,60 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable> // std::condition_variable
+#include <cstddef>            // std::size_t
+#include <deque>              // std::deque
+#include <functional>         // std::function
+#include <memory>             // std::unique_ptr
+#include <mutex>              // std::mutex
+#include <thread>             // std::thread
+#include <vector>             // std::vector
+
+// work-stealing thread pool. every worker has its own queue, which it
+// works through from the back. a worker with an empty queue steals from
+// the front of the others, so uneven tasks (big and small files) still
+// keep all workers busy.
+class ThreadPool
+{
+public:
+    using Task = std::function<void()>;
+
+    // 0 means one worker per hardware thread
+    explicit ThreadPool(std::size_t thread_count = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // can also be called from within a task, then the task is queued on
+    //  the calling worker's own queue
+    void submit(Task task);
+    // blocks until every submitted task has finished
+    void wait();
+
+    std::size_t size() const {
+        return m_threads.size();
+    }
+
+private:
+    struct Queue {
+        std::mutex       mutex;
+        std::deque<Task> tasks;
+    };
+
+    void worker(std::size_t index);
+    bool try_pop(std::size_t index, Task& task);
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread>            m_threads;
+    std::mutex                          m_mutex;
+    std::condition_variable             m_work_cv;
+    std::condition_variable             m_done_cv;
+    // tasks sitting in a queue, and tasks not finished yet (queued or running)
+    std::size_t m_queued  = 0;
+    std::size_t m_pending = 0;
+    std::size_t m_next    = 0;
+    bool        m_stop    = false;
+};
+
+#endif // THREADPOOL_H
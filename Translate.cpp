@@ -0,0 +1,199 @@
+#include "Translate.h"
+
+#include <cstdio> // std::snprintf
+
+#include "Assembler.h"
+#include "Machine.h"
+#include "arch.h"
+
+static constexpr std::size_t MEMORY_WORDS = Machine::MEMORY_WORDS;
+
+static std::string hex(std::uint32_t value) {
+    char buffer[16];
+    std::snprintf(buffer, sizeof(buffer), "0x%03x", value);
+    return buffer;
+}
+
+static std::string label(std::uint32_t address) {
+    return "L_" + hex(address).substr(2);
+}
+
+static bool is_jump(std::uint8_t opcode) {
+    return opcode == JMP || opcode == JGE || opcode == JNE;
+}
+
+bool translate_to_cpp(const std::vector<std::uint16_t>& image, std::string& out) {
+    if (image.size() > MEMORY_WORDS) {
+        return false;
+    }
+    const std::size_t size = image.size();
+
+    // every word is translated as an instruction, as data can be executed too.
+    //  blocks start at the entry point, at jump targets, and after jumps and stops
+    std::vector<bool> leader(size + 1, false);
+    std::vector<bool> written(MEMORY_WORDS, false);
+    leader[0] = true;
+    for (std::size_t i = 0; i < size; ++i) {
+        const auto opcode  = static_cast<std::uint8_t>(image[i] >> 12);
+        const auto operand = static_cast<std::uint16_t>(image[i] & 0xfff);
+        if (is_jump(opcode) && operand < size)
+            leader[operand] = true;
+        if (is_jump(opcode) || opcode == STP)
+            leader[i + 1] = true;
+        if (opcode == STO)
+            written[operand] = true;
+    }
+    // instructions from each leader to the next one
+    std::vector<std::size_t> block_size(size, 0);
+    for (std::size_t i = size; i-- > 0;) {
+        block_size[i] = (i + 1 < size && !leader[i + 1]) ? block_size[i + 1] + 1 : 1;
+    }
+    auto jump_to = [&](std::uint16_t target) -> std::string {
+        if (target < size)
+            return "goto " + label(target) + ";";
+        return "{ pc = " + hex(target) + "; goto interpret; }";
+    };
+
+    out.clear();
+    out += "// generated by mu0asm ";
+    out += assembler_version();
+    out += " from a ";
+    out += std::to_string(size);
+    out += " word image\n"
+           "#include <cstdint>\n"
+           "#include <cstdio>\n"
+           "#include <cstdlib>\n"
+           "\n"
+           "static std::uint16_t mem[4096] = {";
+    for (std::size_t i = 0; i < size; ++i) {
+        out += i % 8 == 0 ? "\n    " : " ";
+        out += "0x";
+        char buffer[8];
+        std::snprintf(buffer, sizeof(buffer), "%04x", image[i]);
+        out += buffer;
+        out += ',';
+    }
+    out += "\n};\n"
+           "\n"
+           "// words of the image the native code runs without checking them first\n"
+           "static const bool unchecked[";
+    out += std::to_string(size + 1);
+    out += "] = {";
+    for (std::size_t i = 0; i < size; ++i) {
+        out += i % 32 == 0 ? "\n    " : " ";
+        out += written[i] ? "0," : "1,";
+    }
+    out += "\n};\n"
+           "\n"
+           "int main(int argc, char** argv) {\n"
+           "    const std::uint64_t max_steps = argc > 1 ? std::strtoull(argv[1], nullptr, 0) : 100000000;\n"
+           "    std::uint16_t       acc       = 0;\n"
+           "    std::uint16_t       pc        = 0;\n"
+           "    std::uint64_t       steps     = 0;\n"
+           "    // cleared once the interpreter changed a word the native code doesn't check\n"
+           "    bool        native = true;\n"
+           "    const char* reason = \"stopped\";\n"
+           "    std::uint16_t word, operand, next;\n";
+    out += size > 0 ? "    goto L_000;\n" : "    goto interpret;\n";
+
+    for (std::size_t i = 0; i < size; ++i) {
+        const auto address = static_cast<std::uint16_t>(i);
+        const auto opcode  = static_cast<std::uint8_t>(image[i] >> 12);
+        const auto operand = static_cast<std::uint16_t>(image[i] & 0xfff);
+        const auto here    = hex(address);
+        if (leader[i]) {
+            out += label(address);
+            out += ":\n    if (max_steps - steps < ";
+            out += std::to_string(block_size[i]);
+            out += ") { pc = " + here + "; goto interpret; }\n";
+        }
+        if (written[i]) {
+            out += "    if (mem[" + here + "] != " + hex(image[i]) + ") { pc = " + here + "; goto interpret; }\n";
+        }
+        out += "    ++steps;\n    ";
+        switch (opcode) {
+        case LDA:
+            out += "acc = mem[" + hex(operand) + "];";
+            break;
+        case STO:
+            out += "mem[" + hex(operand) + "] = acc;";
+            break;
+        case ADD:
+            out += "acc = static_cast<std::uint16_t>(acc + mem[" + hex(operand) + "]);";
+            break;
+        case SUB:
+            out += "acc = static_cast<std::uint16_t>(acc - mem[" + hex(operand) + "]);";
+            break;
+        case JMP:
+            out += jump_to(operand);
+            break;
+        case JGE:
+            out += "if (static_cast<std::int16_t>(acc) >= 0) " + jump_to(operand);
+            break;
+        case JNE:
+            out += "if (acc != 0) " + jump_to(operand);
+            break;
+        case STP:
+            out += "pc = " + here + "; goto done;";
+            break;
+        default:
+            out += "pc = " + here + "; reason = \"invalid instruction\"; goto done;";
+            break;
+        }
+        out += '\n';
+    }
+    if (size > 0) {
+        out += "    pc = " + hex(static_cast<std::uint32_t>(size % MEMORY_WORDS)) + ";\n";
+    }
+
+    out += "interpret:\n"
+           "    while (true) {\n"
+           "        if (steps == max_steps) {\n"
+           "            reason = \"still running\";\n"
+           "            goto done;\n"
+           "        }\n"
+           "        word    = mem[pc];\n"
+           "        operand = word & 0xfff;\n"
+           "        next    = (pc + 1) & 0xfff;\n"
+           "        ++steps;\n"
+           "        switch (word >> 12) {\n"
+           "        case 0: acc = mem[operand]; break;\n"
+           "        case 1:\n"
+           "            mem[operand] = acc;\n"
+           "            if (operand < sizeof(unchecked) - 1 && unchecked[operand])\n"
+           "                native = false;\n"
+           "            break;\n"
+           "        case 2: acc = static_cast<std::uint16_t>(acc + mem[operand]); break;\n"
+           "        case 3: acc = static_cast<std::uint16_t>(acc - mem[operand]); break;\n"
+           "        case 4: next = operand; break;\n"
+           "        case 5: if (static_cast<std::int16_t>(acc) >= 0) next = operand; break;\n"
+           "        case 6: if (acc != 0) next = operand; break;\n"
+           "        case 7: goto done;\n"
+           "        default: reason = \"invalid instruction\"; goto done;\n"
+           "        }\n"
+           "        pc = next;\n"
+           "        if (!native)\n"
+           "            continue;\n"
+           "        switch (pc) {\n";
+    for (std::size_t i = 0; i < size; ++i) {
+        if (leader[i]) {
+            out += "        case " + hex(static_cast<std::uint32_t>(i)) + ": goto " + label(static_cast<std::uint32_t>(i)) + ";\n";
+        }
+    }
+    out += "        default: break;\n"
+           "        }\n"
+           "    }\n"
+           "done:\n"
+           "    std::printf(\"%s at 0x%x after %llu instructions, acc = 0x%x\\n\", reason, pc,\n"
+           "                static_cast<unsigned long long>(steps), acc);\n"
+           "    if (argc > 2) {\n"
+           "        std::FILE* fp = std::fopen(argv[2], \"wb\");\n"
+           "        if (!fp || std::fwrite(mem, sizeof(mem[0]), 4096, fp) != 4096 || std::fclose(fp) != 0) {\n"
+           "            std::perror(argv[2]);\n"
+           "            return 1;\n"
+           "        }\n"
+           "    }\n"
+           "    return 0;\n"
+           "}\n";
+    return true;
+}
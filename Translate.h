@@ -0,0 +1,28 @@
+#ifndef TRANSLATE_H
+#define TRANSLATE_H
+
+#include <cstdint> // std::uint...
+#include <string>  // std::string
+#include <vector>  // std::vector
+
+// turns an assembled program into a self-contained C++ program that runs
+// it natively, replacing out. every basic block becomes a labelled block
+// of C++ and every jump whose target is in the image a goto.
+//
+// MU0 can only store to addresses encoded in its STO instructions, so the
+// words the program can overwrite are known up front. the native code for
+// those words checks that they still hold what was compiled, and falls
+// back to an embedded interpreter if not. the interpreter also runs
+// everything outside the image (like the `ret` of a call, which jumps to
+// a word written at runtime) and goes back to the native code at the
+// start of the next block.
+//
+// the program takes the maximum number of instructions to run as its
+// first argument, and writes the memory it ends with to the file named by
+// the second argument, if given. it prints where it stopped the same way
+// `mu0asm --run` does.
+//
+// returns false if the image doesn't fit into memory
+bool translate_to_cpp(const std::vector<std::uint16_t>& image, std::string& out);
+
+#endif // TRANSLATE_H
@@ -0,0 +1,55 @@
+    jmp +6                      # PC: 0x0000
+    d x = 0x3                   # PC: 0x0001
+    d y = 0x2                   # PC: 0x0002
+    d result = 0x0              # PC: 0x0003
+    d one = 0x1                 # PC: 0x0004
+    d zero = 0x0                # PC: 0x0005
+    lda x                       # PC: 0x0006
+    sto result                  # PC: 0x0007
+    lda x                       # PC: 0x0008
+    sub y                       # PC: 0x0009
+    jne +4                      # PC: 0x000a
+    lda result                  # PC: 0x000b
+    sto zero                    # PC: 0x000c
+    stp                         # PC: 0x000d
+    jmp +23                     # PC: 0x000e
+    jmp +3                      # PC: 0x000f
+    d f_a_a = 0x1               # PC: 0x0010
+    d f_a_b = 0x1               # PC: 0x0011
+    d f_a_r = 0x0               # PC: 0x0012
+    lda f_a_a                   # PC: 0x0013
+    jne +2                      # PC: 0x0014
+    jmp +15                     # PC: 0x0015
+    lda f_a_b                   # PC: 0x0016
+    jne +2                      # PC: 0x0017
+    jmp +15                     # PC: 0x0018
+    lda f_a_a                   # PC: 0x0019
+    sub one                     # PC: 0x001a
+    sto f_a_a                   # PC: 0x001b
+    jne +2                      # PC: 0x001c
+    jmp +7                      # PC: 0x001d
+    lda f_a_b                   # PC: 0x001e
+    sub one                     # PC: 0x001f
+    sto f_a_b                   # PC: 0x0020
+    jne +2                      # PC: 0x0021
+    jmp +5                      # PC: 0x0022
+    jmp -16                     # PC: 0x0023
+    lda one                     # PC: 0x0024
+    sto f_a_r                   # PC: 0x0025
+    jmp +4                      # PC: 0x0026
+    lda zero                    # PC: 0x0027
+    sto f_a_r                   # PC: 0x0028
+    jmp +1                      # PC: 0x0029
+    jmp +9                      # PC: 0x002a
+    lda result                  # PC: 0x002b
+    sub y                       # PC: 0x002c
+    sto result                  # PC: 0x002d
+    lda y                       # PC: 0x002e
+    sto f_a_a                   # PC: 0x002f
+    lda result                  # PC: 0x0030
+    sto f_a_b                   # PC: 0x0031
+    jmp -31                     # PC: 0x0032
+    lda f_a_r                   # PC: 0x0033
+    jne -9                      # PC: 0x0034
+    lda result                  # PC: 0x0035
+    stp                         # PC: 0x0036
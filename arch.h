@@ -1,9 +1,9 @@
 #ifndef ARCH_H
 #define ARCH_H
 
+#include <array>
 #include <cstdint>
-#include <map>
-#include <string>
+#include <string_view>
 
 // will be padded by the compiler, but we cannot explicitly
 //  pad this as we may cast between this and std::uint16_t at
@@ -13,6 +13,19 @@ struct instruction_t {
     unsigned int opcode : 4;
 };
 
+// instruction_t <-> the 16 bit word it is in memory, without relying on
+//  the layout the compiler picked for the bitfields
+static constexpr std::uint16_t word_from_instr(instruction_t i) {
+    return static_cast<std::uint16_t>((i.opcode << 12) | i.S);
+}
+
+static constexpr instruction_t instr_from_word(std::uint16_t word) {
+    instruction_t i {};
+    i.S      = word & 0xfff;
+    i.opcode = (word >> 12) & 0xf;
+    return i;
+}
+
 enum Instr : std::uint8_t
 {
     LDA = 0b0000,
@@ -33,7 +46,13 @@ enum Instr : std::uint8_t
     INVALID,
 };
 
-static const std::map<std::string, Instr> g_name_instr_map = {
+struct InstrName {
+    std::string_view name;
+    Instr            instr;
+};
+
+// the first name of an instruction is the one it's written as
+static constexpr InstrName g_instr_names[] = {
     { "lda", Instr::LDA },
     { "sto", Instr::STO },
     { "add", Instr::ADD },
@@ -45,6 +64,8 @@ static const std::map<std::string, Instr> g_name_instr_map = {
     { "call", Instr::CALL },
     { "ret", Instr::RET },
     { "d", Instr::DATA },
+    // data the program runs as an instruction on purpose, never moved
+    { "dx", Instr::DATA },
     { ".label", Instr::LABEL }
 };
 
@@ -53,9 +74,69 @@ static constexpr char VAR[]   = "$";
 static constexpr char LABEL[] = ".";
 }
 
-struct instr_arg_pair_t {
-    Instr       instr;
-    std::string arg;
+// the name of every instruction, indexed by Instr
+static constexpr std::array<std::string_view, Instr::INVALID + 1> g_instr_name_table = [] {
+    std::array<std::string_view, Instr::INVALID + 1> table {};
+    for (auto& name : table) {
+        name = "(unknown instruction)";
+    }
+    // backwards, so the first name of an instruction wins
+    for (std::size_t i = std::size(g_instr_names); i-- > 0;) {
+        table[g_instr_names[i].instr] = g_instr_names[i].name;
+    }
+    return table;
+}();
+
+static constexpr std::string_view name_from_instr(Instr i) {
+    return i <= Instr::INVALID ? g_instr_name_table[i] : g_instr_name_table[Instr::INVALID];
+}
+
+// case-insensitive, anything starting with Prefix::LABEL is a label
+static constexpr Instr instr_from_name(std::string_view name) {
+    if (name.starts_with(Prefix::LABEL)) {
+        return Instr::LABEL;
+    }
+    for (const InstrName& entry : g_instr_names) {
+        if (entry.name.size() != name.size()) {
+            continue;
+        }
+        std::size_t i = 0;
+        for (; i < name.size(); ++i) {
+            const char c = name[i] >= 'A' && name[i] <= 'Z' ? static_cast<char>(name[i] - 'A' + 'a') : name[i];
+            if (c != entry.name[i]) {
+                break;
+            }
+        }
+        if (i == name.size()) {
+            return entry.instr;
+        }
+    }
+    return Instr::INVALID;
+}
+
+static constexpr bool instr_expects_arg(Instr i) {
+    // anything up to STP (not including STP) expects an argument
+    return i < STP || i == CALL || i == DATA;
+}
+
+static constexpr bool is_standard_instr(const Instr& i) {
+    return i < Instr::END_STD_INSTR_SET;
+}
+
+// how `call` and `ret` are turned into MU0 instructions
+enum class CallConvention : std::uint8_t
+{
+    // the return address is kept in SUBR_PC_LOC, so calls can't be nested
+    Inline,
+    // return addresses are pushed onto a stack after the program, by
+    //  routines shared by all calls
+    Stack,
+};
+
+// 1-based position of a token in the source
+struct source_location_t {
+    std::uint32_t line;
+    std::uint32_t column;
 };
 
 #endif // ARCH_H
@@ -0,0 +1,52 @@
+#include "AllocationCounter.h"
+
+#include <atomic>  // std::atomic
+#include <cstddef> // std::size_t
+#include <cstdlib> // std::malloc, std::aligned_alloc, std::free
+#include <new>     // std::bad_alloc, std::align_val_t
+
+static std::atomic<std::uint64_t> allocations { 0 };
+static std::atomic<std::uint64_t> allocated_bytes { 0 };
+
+AllocationCount allocations_so_far() {
+    return { allocations.load(std::memory_order_relaxed), allocated_bytes.load(std::memory_order_relaxed) };
+}
+
+// operator new[] and the nothrow forms end up in one of the two below, the
+// aligned ones in the second
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size == 0 ? 1 : size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    // aligned_alloc takes only whole multiples of the alignment
+    const auto        align = static_cast<std::size_t>(alignment);
+    const std::size_t bytes = ((size == 0 ? 1 : size) + align - 1) / align * align;
+    if (void* memory = std::aligned_alloc(align, bytes)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept {
+    std::free(memory);
+}
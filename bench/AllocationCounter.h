@@ -0,0 +1,15 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <cstdint> // std::uint...
+
+// allocations of the whole process so far, counted by the replaced global
+//  operator new. what a phase allocated is the difference around it
+struct AllocationCount {
+    std::uint64_t allocations = 0;
+    std::uint64_t bytes       = 0;
+};
+
+AllocationCount allocations_so_far();
+
+#endif // ALLOCATIONCOUNTER_H
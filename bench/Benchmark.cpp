@@ -0,0 +1,286 @@
+#include <algorithm>  // std::min, std::sort, std::count
+#include <charconv>   // std::from_chars
+#include <chrono>     // std::chrono
+#include <filesystem> // std::filesystem
+#include <fstream>    // std::ifstream
+#include <iomanip>    // std::setprecision
+#include <memory>     // std::unique_ptr
+#include <sstream>    // std::ostringstream
+#include <string>     // std::string
+#include <vector>     // std::vector
+
+#include "AllocationCounter.h"
+#include "Assembler.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "SourceGenerator.h"
+#include "debug.h"
+
+static void print_usage() {
+    std::cerr << "usage: mu0asm_bench [options] [<file or dir>...]\n"
+              << "  measures how fast each phase of the assembler is on every .asm file given,\n"
+              << "  or in the example directory if none is, and on a generated program. prints\n"
+              << "  the results as json\n"
+              << "  --lines <n>     lines of the generated program, default is 100000, 0 for none\n"
+              << "  --labels <f>    share of its lines that are labels, default is 0.05\n"
+              << "  --data <f>      share that declares data, default is 0.10\n"
+              << "  --calls <f>     share that are calls or rets, default is 0.02\n"
+              << "  --comments <f>  share that are comments, default is 0.10\n"
+              << "  --seed <n>      seed of the generator, default is 1\n"
+              << "  --repeat <n>    run every phase <n> times and keep the fastest, default is 5\n"
+              << "  --call-stack    assemble calls with CallConvention::Stack\n";
+}
+
+namespace {
+struct Input {
+    std::string name;
+    std::string source;
+};
+
+struct PhaseResult {
+    const char*   name;
+    double        seconds = 0;
+    std::uint64_t allocations = 0;
+    std::uint64_t allocated_bytes = 0;
+};
+
+struct InputResult {
+    std::string              name;
+    std::size_t              lines = 0;
+    std::size_t              words = 0;
+    std::size_t              errors = 0;
+    std::vector<PhaseResult> phases;
+};
+
+template <typename T>
+bool parse_value(const std::string& value, T& result) {
+    auto parsed = std::from_chars(value.data(), value.data() + value.size(), result);
+    if (parsed.ec != std::errc() || parsed.ptr != value.data() + value.size()) {
+        fatal("expected a number, got '" << value << "'");
+        return false;
+    }
+    return true;
+}
+
+bool read_file(const std::filesystem::path& path, std::vector<Input>& inputs) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        fatal("could not open '" << path.string() << "'");
+        return false;
+    }
+    std::ostringstream source;
+    source << file.rdbuf();
+    inputs.push_back({ path.string(), source.str() });
+    return true;
+}
+
+// every .asm file in path, sorted so the output is always in the same order
+bool read_inputs(const std::filesystem::path& path, std::vector<Input>& inputs) {
+    if (!std::filesystem::is_directory(path)) {
+        return read_file(path, inputs);
+    }
+    std::vector<std::filesystem::path> files;
+    for (const auto& entry : std::filesystem::directory_iterator(path)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".asm") {
+            files.push_back(entry.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    for (const auto& file : files) {
+        if (!read_file(file, inputs)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// runs every phase of assembling input repeat times, a new parser each
+//  time, and keeps the fastest time of each phase. the allocations are the
+//  same every time, so the ones of the last run are kept
+InputResult measure(const Input& input, std::size_t repeat, CallConvention calls, const std::filesystem::path& scratch) {
+    InputResult result;
+    result.name  = input.name;
+    result.lines = static_cast<std::size_t>(std::count(input.source.begin(), input.source.end(), '\n'));
+    if (!input.source.empty() && input.source.back() != '\n') {
+        ++result.lines;
+    }
+    const std::string out_path = (scratch / "bench.out").string();
+    const std::string asm_path = (scratch / "bench.asm").string();
+
+    for (std::size_t run = 0; run < repeat; ++run) {
+        std::size_t phase = 0;
+        auto        time  = [&](const char* name, auto&& body) {
+            const AllocationCount before = allocations_so_far();
+            const auto            start  = std::chrono::steady_clock::now();
+            body();
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (phase == result.phases.size()) {
+                result.phases.push_back({ name, seconds });
+            }
+            PhaseResult& measured    = result.phases[phase++];
+            measured.seconds         = std::min(measured.seconds, seconds);
+            const AllocationCount after = allocations_so_far();
+            measured.allocations     = after.allocations - before.allocations;
+            measured.allocated_bytes = after.bytes - before.bytes;
+        };
+
+        std::unique_ptr<Parser> parser;
+        time("tokenize", [&] {
+            SourceBuffer source;
+            source.wrap(input.source);
+            parser = std::make_unique<Parser>(std::move(source), calls);
+        });
+        // a program with errors stops where the assembler would
+        if (parser->invalid()) {
+            result.errors = parser->diagnostics().size();
+            continue;
+        }
+        time("define_data", [&] { parser->define_all_data(); });
+        time("encode", [&] { parser->encode_all(); });
+        time("write_binary", [&] { parser->write_to(out_path); });
+        time("write_listing", [&] { parser->write_asm_to(asm_path); });
+        result.words  = parser->instrs().size();
+        result.errors = parser->diagnostics().size();
+    }
+    return result;
+}
+
+// escapes what a json string can't hold as it is
+std::string json_string(const std::string& text) {
+    std::string escaped = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            std::ostringstream code;
+            code << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c);
+            escaped += code.str();
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped + "\"";
+}
+
+void write_json(std::ostream& out, const std::vector<InputResult>& results) {
+    out << "{\n  \"version\": " << json_string(assembler_version()) << ",\n  \"inputs\": [";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const InputResult& result = results[i];
+        out << (i == 0 ? "\n" : ",\n") << "    {\n"
+            << "      \"name\": " << json_string(result.name) << ",\n"
+            << "      \"lines\": " << result.lines << ",\n"
+            << "      \"words\": " << result.words << ",\n"
+            << "      \"errors\": " << result.errors << ",\n"
+            << "      \"phases\": [";
+        for (std::size_t j = 0; j < result.phases.size(); ++j) {
+            const PhaseResult& phase = result.phases[j];
+            out << (j == 0 ? "\n" : ",\n") << "        { \"name\": " << json_string(phase.name)
+                << ", \"seconds\": " << std::setprecision(9) << phase.seconds << ", \"lines_per_second\": "
+                << std::setprecision(6) << (phase.seconds > 0 ? static_cast<double>(result.lines) / phase.seconds : 0.0)
+                << ", \"allocations\": " << phase.allocations << ", \"allocated_bytes\": " << phase.allocated_bytes
+                << " }";
+        }
+        out << (result.phases.empty() ? "]\n" : "\n      ]\n") << "    }";
+    }
+    out << (results.empty() ? "]\n" : "\n  ]\n") << "}\n";
+}
+
+// one line per phase, for reading the results without a json tool
+void write_summary(std::ostream& out, const std::vector<InputResult>& results) {
+    for (const InputResult& result : results) {
+        out << result.name << ": " << result.lines << " lines, " << result.words << " words";
+        if (result.errors > 0) {
+            out << ", " << result.errors << " errors";
+        }
+        out << "\n";
+        for (const PhaseResult& phase : result.phases) {
+            out << "  " << std::left << std::setw(14) << phase.name << std::right << std::setw(12) << std::fixed
+                << std::setprecision(3) << phase.seconds * 1e3 << " ms " << std::setw(14) << std::setprecision(0)
+                << (phase.seconds > 0 ? static_cast<double>(result.lines) / phase.seconds : 0.0) << " lines/s "
+                << std::setw(10) << phase.allocations << " allocs " << std::setw(12) << phase.allocated_bytes
+                << " bytes\n";
+        }
+        out.unsetf(std::ios::fixed);
+    }
+}
+}
+
+int main(int argc, char** argv) {
+    GeneratorOptions         generator;
+    std::size_t              repeat = 5;
+    CallConvention           calls  = CallConvention::Inline;
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--lines" || arg == "--labels" || arg == "--data" || arg == "--calls" || arg == "--comments"
+            || arg == "--seed" || arg == "--repeat") {
+            if (i + 1 == argc) {
+                fatal("option '" << arg << "' expects an argument");
+                print_usage();
+                return -1;
+            }
+            std::string value = argv[++i];
+            bool        parsed = arg == "--lines"    ? parse_value(value, generator.lines)
+                               : arg == "--labels"   ? parse_value(value, generator.labels)
+                               : arg == "--data"     ? parse_value(value, generator.data)
+                               : arg == "--calls"    ? parse_value(value, generator.calls)
+                               : arg == "--comments" ? parse_value(value, generator.comments)
+                               : arg == "--seed"     ? parse_value(value, generator.seed)
+                                                     : parse_value(value, repeat);
+            if (!parsed) {
+                return -1;
+            }
+        } else if (arg == "--call-stack") {
+            calls = CallConvention::Stack;
+        } else if (arg == "-h" || arg == "--help") {
+            print_usage();
+            return 0;
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            fatal("unknown option '" << arg << "'");
+            print_usage();
+            return -1;
+        } else {
+            paths.push_back(std::move(arg));
+        }
+    }
+    if (repeat == 0) {
+        fatal("--repeat has to be at least 1");
+        return -1;
+    }
+
+    std::vector<Input> inputs;
+#ifdef MU0ASM_BENCH_CORPUS
+    if (paths.empty()) {
+        paths.push_back(MU0ASM_BENCH_CORPUS);
+    }
+#endif
+    for (const std::string& path : paths) {
+        if (!read_inputs(path, inputs)) {
+            return -1;
+        }
+    }
+    if (generator.lines > 0) {
+        inputs.push_back({ "generated-" + std::to_string(generator.lines), generate_source(generator) });
+    }
+
+    // the outputs are written, to measure that too, but not kept
+    const std::filesystem::path scratch = std::filesystem::temp_directory_path() / "mu0asm_bench";
+    std::filesystem::create_directories(scratch);
+    // diagnostics of the inputs would only drown out the results
+    std::ostringstream discarded;
+    diagnostic_stream() = &discarded;
+
+    std::vector<InputResult> results;
+    for (const Input& input : inputs) {
+        results.push_back(measure(input, repeat, calls, scratch));
+        discarded.str({});
+    }
+    diagnostic_stream() = &std::cerr;
+    std::filesystem::remove_all(scratch);
+
+    write_json(std::cout, results);
+    write_summary(std::cerr, results);
+    return 0;
+}
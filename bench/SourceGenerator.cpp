@@ -0,0 +1,88 @@
+#include "SourceGenerator.h"
+
+#include <random> // std::mt19937, std::uniform_...
+#include <vector> // std::vector
+
+namespace {
+enum class LineKind : std::uint8_t
+{
+    Instruction,
+    Label,
+    Data,
+    Call,
+    Comment,
+};
+}
+
+std::string generate_source(const GeneratorOptions& options) {
+    std::mt19937                           rng(options.seed);
+    std::uniform_real_distribution<double> share(0.0, 1.0);
+
+    // what every line is decides how many labels and data there are, which
+    //  instructions then refer to
+    std::vector<LineKind> kinds(options.lines, LineKind::Instruction);
+    std::size_t           labels = 0, data = 0;
+    for (LineKind& kind : kinds) {
+        double r = share(rng);
+        if ((r -= options.labels) < 0) {
+            kind = LineKind::Label;
+            ++labels;
+        } else if ((r -= options.data) < 0) {
+            kind = LineKind::Data;
+            ++data;
+        } else if ((r -= options.calls) < 0) {
+            kind = LineKind::Call;
+        } else if ((r -= options.comments) < 0) {
+            kind = LineKind::Comment;
+        }
+    }
+    // the first line is a label and the last one data, so there always
+    //  is something to refer to
+    if (!kinds.empty() && kinds.front() != LineKind::Label) {
+        labels += 1;
+        data -= kinds.front() == LineKind::Data ? std::size_t { 1 } : 0;
+        kinds.front() = LineKind::Label;
+    }
+    if (kinds.size() > 1 && kinds.back() != LineKind::Data) {
+        data += 1;
+        labels -= kinds.back() == LineKind::Label ? std::size_t { 1 } : 0;
+        kinds.back() = LineKind::Data;
+    }
+
+    static constexpr const char* DATA_INSTRS[] = { "lda", "sto", "add", "sub" };
+    static constexpr const char* JUMP_INSTRS[] = { "jmp", "jge", "jne" };
+    std::string                  source;
+    source.reserve(options.lines * 16);
+    std::size_t next_label = 0, next_data = 0;
+    auto        any_label  = [&] {
+        return std::to_string(std::uniform_int_distribution<std::size_t>(0, labels - 1)(rng));
+    };
+    auto any_data = [&] {
+        return std::to_string(std::uniform_int_distribution<std::size_t>(0, data - 1)(rng));
+    };
+    for (LineKind kind : kinds) {
+        switch (kind) {
+        case LineKind::Label:
+            source += ".l" + std::to_string(next_label++) + ":\n";
+            break;
+        case LineKind::Data:
+            source += "d v" + std::to_string(next_data++) + " = " + std::to_string(rng() % 0x10000) + "\n";
+            break;
+        case LineKind::Call:
+            // about one ret per four calls, like short subroutines
+            source += rng() % 4 == 0 ? "ret\n" : "call .l" + any_label() + "\n";
+            break;
+        case LineKind::Comment:
+            source += "# generated line, nothing to see here\n";
+            break;
+        case LineKind::Instruction:
+            if (rng() % 8 == 0) {
+                source += std::string(JUMP_INSTRS[rng() % 3]) + " .l" + any_label() + "\n";
+            } else {
+                source += std::string(DATA_INSTRS[rng() % 4]) + " $v" + any_data() + "\n";
+            }
+            break;
+        }
+    }
+    return source;
+}
@@ -0,0 +1,23 @@
+#ifndef SOURCEGENERATOR_H
+#define SOURCEGENERATOR_H
+
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uint...
+#include <string>  // std::string
+
+struct GeneratorOptions {
+    std::size_t lines = 100000;
+    // share of the lines that are labels, `d` declarations, calls (and
+    //  rets) and comments. the rest are instructions
+    double        labels   = 0.05;
+    double        data     = 0.10;
+    double        calls    = 0.02;
+    double        comments = 0.10;
+    std::uint32_t seed     = 1;
+};
+
+// a program of options.lines lines, made of the same kinds of lines as
+// programs people write. it isn't meant to be run, only to be assembled
+std::string generate_source(const GeneratorOptions& options);
+
+#endif // SOURCEGENERATOR_H
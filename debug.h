@@ -8,12 +8,19 @@
 #define ansi_red "\u001b[31m"
 #define ansi_gray "\u001b[38;5;8m"
 
+// stream errors are reported to. it's std::cerr unless redirected for the
+//  current thread, which is how concurrent assemblies keep their messages apart
+inline std::ostream*& diagnostic_stream() {
+    thread_local std::ostream* stream = &std::cerr;
+    return stream;
+}
+
 // error macro to report errors, using std::dec to avoid printing line in hex
 //  since for some reason that can happen when x specifies it
-#define error(x) std::cerr << __FUNCTION__ << ":" << std::dec << __LINE__ << ": " \
-                           << ansi_red << "error: " << ansi_reset << x << std::endl
-#define fatal(x) std::cerr << __FUNCTION__ << ":" << std::dec << __LINE__ << ": " \
-                           << ansi_red << "fatal: " << ansi_reset << x << std::endl
+#define error(x) *diagnostic_stream() << __FUNCTION__ << ":" << std::dec << __LINE__ << ": " \
+                                      << ansi_red << "error: " << ansi_reset << x << std::endl
+#define fatal(x) *diagnostic_stream() << __FUNCTION__ << ":" << std::dec << __LINE__ << ": " \
+                                      << ansi_red << "fatal: " << ansi_reset << x << std::endl
 #if 0
 #define log(x) std::cout << __FUNCTION__ << ":" << std::dec << __LINE__ << ": log: " \
                          << x << std::endl
@@ -1,24 +1,608 @@
+#include <algorithm>  // std::min, std::count
+#include <charconv>   // std::from_chars
+#include <chrono>     // std::chrono
+#include <filesystem> // std::filesystem
+#include <fstream>    // std::ifstream
+#include <memory>     // std::unique_ptr
+#include <set>        // std::set
+#include <sstream>    // std::ostringstream
+#include <string>     // std::string
+#include <thread>     // std::this_thread
+#include <vector>     // std::vector
+
+#include "Assembler.h"
+#include "Cache.h"
+#include "Incremental.h"
+#include "Lexer.h"
+#include "Machine.h"
+#include "Profiler.h"
+#include "Stats.h"
+#include "Superopt.h"
+#include "ThreadPool.h"
+#include "Translate.h"
 #include "debug.h"
-#include "Parser.h"
+
+static void print_usage() {
+    std::cerr << "usage: mu0asm [options] <file>...\n"
+              << "  -o <pattern>  name of the output files, '{name}' is replaced by the name of\n"
+              << "                the input without extension, '{ext}' by 'out' or 'asm'.\n"
+              << "                default is 'a.{ext}' for one input, '{name}.{ext}' for more\n"
+              << "  -d <dir>      write the outputs into <dir>, same as -o '<dir>/{name}.{ext}'\n"
+              << "  -j<n>, -j <n> assemble on <n> threads, default is one per core. a single\n"
+              << "                large file is parsed and encoded on all of them\n"
+              << "  -O            remove instructions that don't change what the program does\n"
+              << "  --call-stack  keep return addresses on a stack, so calls can be nested\n"
+              << "  --inline <n>  replace calls of subroutines of up to <n> instructions, which\n"
+              << "                don't call anything themselves, with the subroutine\n"
+              << "  --blocks      start every basic block of the listing with the cycles it takes\n"
+              << "                and where it goes, and the listing with its loops\n"
+              << "  --dead        point out code that can't run and data nothing uses\n"
+              << "  --strip-dead  same as --dead, and remove it\n"
+              << "  --superopt <n>\n"
+              << "                replace runs of up to <n> lda, sto, add and sub with the shortest\n"
+              << "                run that does the same, found by searching all of them\n"
+              << "  --superopt-db <file>\n"
+              << "                where searched runs are kept for later, default is\n"
+              << "                'mu0asm.superopt'\n"
+              << "  --move-data   move data that isn't run behind the code, and remove the jumps\n"
+              << "                over it\n"
+              << "  --merge-constants\n"
+              << "                keep one word of every value declared with 'd' and never stored to\n"
+              << "  --cache-dir <dir>\n"
+              << "                reuse results of earlier runs for unchanged sources, stored in <dir>\n"
+              << "  --cache-size <MiB>\n"
+              << "                size the cache is kept under, default is 256 MiB\n"
+              << "  --cpp         also write the program as a C++ program that runs it natively,\n"
+              << "                to '{ext}' = 'cpp'\n"
+              << "  -g            also write where every word came from in the source, to\n"
+              << "                '{ext}' = 'dbg'\n"
+              << "  --run         run each program after assembling it, and print where it stopped\n"
+              << "  --profile     same as --run, and print which lines, calls and jumps the\n"
+              << "                cycles went to\n"
+              << "  --max-steps <n>\n"
+              << "                stop a program after <n> instructions, default is 100000000\n"
+              << "  --stats       print how long each phase took and what was done, like how many\n"
+              << "                lines were parsed and words encoded, when done\n"
+              << "  --stats-json <file>\n"
+              << "                write the same as json to <file>, '-' is stdout\n"
+              << "  --watch       keep assembling the (single) input whenever it changes,\n"
+              << "                only parsing what changed and patching the outputs\n"
+              << "  --version     print the version and exit\n";
+}
+
+struct Job {
+    std::string input;
+    std::string out_path;
+    std::string asm_path;
+    // empty unless the C++ translation is written too
+    std::string cpp_path;
+    // empty unless the debug info is written too
+    std::string dbg_path;
+    std::string messages;
+    // what running the program did, empty if it wasn't run
+    std::string       run_report;
+    bool              optimize          = false;
+    std::size_t       inline_size       = 0;
+    bool              merge_constants   = false;
+    bool              relocate_data     = false;
+    bool              annotate_listing  = false;
+    DeadCodeMode      dead_code         = DeadCodeMode::Keep;
+    std::size_t       superopt_length   = 0;
+    std::size_t       superopt_threads  = 1;
+    std::size_t       parse_threads     = 1;
+    SuperoptDatabase* superopt_database = nullptr;
+    CallConvention    calls             = CallConvention::Inline;
+    // instructions the program may run for, 0 means it isn't run
+    std::uint64_t max_steps = 0;
+    // also report where the cycles of the run went
+    bool           profile = false;
+    AssemblyStatus status  = AssemblyStatus::Ok;
+    std::size_t    words   = 0;
+};
+
+static std::string output_name(const std::string& pattern, const std::string& input, const char* ext) {
+    const std::string name = std::filesystem::path(input).stem().string();
+    std::string       result;
+    for (std::size_t i = 0; i < pattern.size(); ++i) {
+        if (pattern.compare(i, 6, "{name}") == 0) {
+            result += name;
+            i += 5;
+        } else if (pattern.compare(i, 5, "{ext}") == 0) {
+            result += ext;
+            i += 4;
+        } else {
+            result += pattern[i];
+        }
+    }
+    return result;
+}
+
+static bool parse_count(const std::string& value, std::size_t& count) {
+    auto result = std::from_chars(value.data(), value.data() + value.size(), count);
+    if (result.ec != std::errc() || result.ptr != value.data() + value.size()) {
+        fatal("expected a number, got '" << value << "'");
+        return false;
+    }
+    return true;
+}
+
+static AssemblyResult assemble_input(const std::string& input, const AssemblyOptions& options, AssemblyCache* cache) {
+    if (cache) {
+        SourceBuffer source;
+        if (source.map_file(input)) {
+            return cache->assemble(source.view(), options);
+        }
+        // let the parser report why the file can't be read
+    }
+    return assemble_file(input, options);
+}
+
+// with debug, the report ends with a profile of the run, see profile_report
+static std::string run_program(const std::vector<std::uint16_t>& image, std::uint64_t max_steps, const DebugInfo* debug = nullptr) {
+    Machine machine;
+    if (!machine.load(image)) {
+        return "not run, " + std::to_string(image.size()) + " words don't fit into memory";
+    }
+    Profile            profile;
+    RunResult          result = debug ? machine.run(max_steps, profile) : machine.run(max_steps);
+    std::ostringstream report;
+    switch (result.reason) {
+    case StopReason::Stopped:
+        report << "stopped at ";
+        break;
+    case StopReason::InvalidOpcode:
+        report << "invalid instruction at ";
+        break;
+    case StopReason::StepLimit:
+        report << "still running at ";
+        break;
+    }
+    report << "0x" << std::hex << result.pc << std::dec << " after " << result.steps << " instructions, acc = 0x"
+           << std::hex << result.acc << std::dec << " (" << static_cast<std::uint64_t>(result.instructions_per_second())
+           << " instructions/s)";
+    if (debug) {
+        report << "\n" << profile_report(profile, *debug, image);
+    }
+    return report.str();
+}
+
+// writes all outputs of job but the run report
+static void write_outputs(Job& job, const AssemblyResult& result) {
+    PhaseTimer timer(StatPhase::Write);
+    for (const std::string& path : { job.out_path, job.asm_path, job.dbg_path }) {
+        auto dir = std::filesystem::path(path).parent_path();
+        if (!dir.empty()) {
+            std::error_code ec;
+            std::filesystem::create_directories(dir, ec);
+        }
+    }
+    write_text(job.asm_path, result.listing);
+    if (!job.dbg_path.empty()) {
+        write_text(job.dbg_path, result.debug_info.to_text());
+    }
+    if (!job.cpp_path.empty()) {
+        std::string cpp;
+        if (!translate_to_cpp(result.image, cpp)) {
+            error("the program doesn't fit into memory, not writing '" << job.cpp_path << "'");
+        } else {
+            write_text(job.cpp_path, cpp);
+        }
+    }
+    if (!write_image(job.out_path, result.image)) {
+        job.status = AssemblyStatus::Failed;
+    }
+}
+
+static void assemble(Job& job, AssemblyCache* cache) {
+    AssemblyOptions options;
+    options.listing           = true;
+    options.annotate_listing  = job.annotate_listing;
+    options.debug_info        = !job.dbg_path.empty() || job.profile;
+    options.optimize          = job.optimize;
+    options.inline_size       = job.inline_size;
+    options.merge_constants   = job.merge_constants;
+    options.relocate_data     = job.relocate_data;
+    options.dead_code         = job.dead_code;
+    options.superopt_length   = job.superopt_length;
+    options.superopt_database = job.superopt_database;
+    options.superopt_threads  = job.superopt_threads;
+    options.parse_threads     = job.parse_threads;
+    options.calls             = job.calls;
+    AssemblyResult result     = assemble_input(job.input, options, cache);
+    for (const Diagnostic& diagnostic : result.diagnostics) {
+        *diagnostic_stream() << format_diagnostic(job.input, diagnostic) << "\n";
+    }
+    for (const Diagnostic& note : result.notes) {
+        *diagnostic_stream() << format_diagnostic(job.input, note, "note") << "\n";
+    }
+    job.status = result.status;
+    if (result.status == AssemblyStatus::Failed) {
+        fatal("errors occurred during initial parsing.");
+        return;
+    } else {
+        log("initial parsing ok");
+    }
+    job.words = result.image.size();
+
+    write_outputs(job, result);
+    // an image with errors is likely wrong, so there's no point in running it
+    if (job.max_steps != 0 && job.status == AssemblyStatus::Ok) {
+        PhaseTimer run_timer(StatPhase::Run);
+        job.run_report = run_program(result.image, job.max_steps, job.profile ? &result.debug_info : nullptr);
+    }
+}
+
+static int assemble_all(std::vector<Job>& jobs, std::size_t thread_count, AssemblyCache* cache) {
+    auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(std::min(thread_count, jobs.size()));
+        for (Job& job : jobs) {
+            pool.submit([&job, cache] {
+                // collect messages per file, so they can be reported together
+                std::ostringstream messages;
+                diagnostic_stream() = &messages;
+                assemble(job, cache);
+                diagnostic_stream() = &std::cerr;
+                job.messages        = messages.str();
+            });
+        }
+        pool.wait();
+    }
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+
+    std::size_t ok = 0, with_errors = 0, failed = 0, words = 0;
+    for (const Job& job : jobs) {
+        if (!job.messages.empty()) {
+            std::cerr << "==> " << job.input << " <==\n"
+                      << job.messages;
+        }
+        if (!job.run_report.empty()) {
+            std::cout << job.input << ": " << job.run_report << "\n";
+        }
+        switch (job.status) {
+        case AssemblyStatus::Ok:
+            ++ok;
+            break;
+        case AssemblyStatus::Errors:
+            ++with_errors;
+            break;
+        case AssemblyStatus::Failed:
+            ++failed;
+            break;
+        }
+        words += job.words;
+    }
+    std::cerr << "assembled " << jobs.size() << " files (" << words << " words) in "
+              << elapsed.count() << " ms: " << ok << " ok, " << with_errors
+              << " with errors, " << failed << " failed" << std::endl;
+    if (cache) {
+        std::cerr << "cache: " << cache->hits() << " hits, " << cache->misses() << " misses" << std::endl;
+    }
+    return (with_errors + failed) == 0 ? 0 : 1;
+}
+
+// prints the stats when main returns, whichever way it does
+struct StatsReport {
+    bool        text = false;
+    // empty if no json is written, '-' for stdout
+    std::string json_path;
+
+    ~StatsReport() {
+        if (!stats_enabled()) {
+            return;
+        }
+        const StatsSnapshot snapshot = stats_snapshot();
+        if (text) {
+            std::cerr << snapshot.to_text() << std::flush;
+        }
+        if (json_path == "-") {
+            std::cout << snapshot.to_json() << std::flush;
+        } else if (!json_path.empty() && !write_text(json_path, snapshot.to_json())) {
+            error("could not write '" << json_path << "'");
+        }
+    }
+};
+
+static bool read_source(const std::string& filename, std::string& source) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    source.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return !file.bad();
+}
+
+// assembles the input every time it changes, until interrupted
+static int watch(const Job& job) {
+    std::string source;
+    if (!read_source(job.input, source)) {
+        fatal("file '" << job.input << "' not found");
+        return -1;
+    }
+    for (const std::string& path : { job.out_path, job.asm_path, job.dbg_path }) {
+        auto dir = std::filesystem::path(path).parent_path();
+        if (!dir.empty()) {
+            std::error_code ec;
+            std::filesystem::create_directories(dir, ec);
+        }
+    }
+
+    auto                           start = std::chrono::steady_clock::now();
+    IncrementalParser::UpdateStats stats;
+    stats.full         = true;
+    stats.lines_parsed = static_cast<std::size_t>(std::count(source.begin(), source.end(), '\n'));
+    IncrementalParser parser(std::move(source));
+    stats.instrs_encoded = parser.instrs().size();
+    // what a.out holds right now, so only the difference has to be written
+    std::vector<std::uint16_t> written;
+    bool                       have_written = false;
+
+    std::error_code ec;
+    auto            last_time = std::filesystem::last_write_time(job.input, ec);
+    auto            last_size = std::filesystem::file_size(job.input, ec);
+    while (true) {
+        for (const Diagnostic& diagnostic : parser.diagnostics()) {
+            std::cerr << format_diagnostic(job.input, diagnostic) << "\n";
+        }
+        if (parser.invalid()) {
+            std::cerr << job.input << ": " << parser.diagnostics().size() << " errors, outputs not updated" << std::endl;
+        } else {
+            PhaseTimer                 timer(StatPhase::Write);
+            std::vector<std::uint16_t> image = parser.image();
+            long                       patched;
+            if (have_written) {
+                patched = patch_image(job.out_path, written, image);
+            } else {
+                patched = write_image(job.out_path, image) ? static_cast<long>(image.size()) : -1;
+            }
+            parser.write_asm_to(job.asm_path, job.annotate_listing);
+            if (!job.dbg_path.empty()) {
+                write_text(job.dbg_path, parser.debug_info().to_text());
+            }
+            if (patched >= 0) {
+                written      = std::move(image);
+                have_written = true;
+            }
+            auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+            std::cerr << job.input << ": " << (stats.full ? "parsed " : "parsed only ") << stats.lines_parsed << " lines, encoded "
+                      << stats.instrs_encoded << " instructions (" << stats.refs_resolved << " references resolved again), wrote "
+                      << patched << " of " << written.size() << " words in " << elapsed.count() << " ms" << std::endl;
+        }
+
+        // poll, which works the same on every filesystem and with every editor
+        while (true) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            auto time = std::filesystem::last_write_time(job.input, ec);
+            // editors that replace the file make it disappear for a moment
+            if (ec) {
+                continue;
+            }
+            auto size = std::filesystem::file_size(job.input, ec);
+            if (!ec && (time != last_time || size != last_size)) {
+                last_time = time;
+                last_size = size;
+                break;
+            }
+        }
+        if (!read_source(job.input, source)) {
+            continue;
+        }
+        start = std::chrono::steady_clock::now();
+        stats = parser.update(std::move(source));
+    }
+}
 
 int main(int argc, char** argv) {
-    if (argc == 1) {
+    std::vector<std::string> inputs;
+    std::string              pattern;
+    std::size_t              thread_count = 0;
+    std::string              cache_dir;
+    std::size_t              cache_mib        = 256;
+    bool                     watch_input      = false;
+    bool                     run              = false;
+    bool                     cpp              = false;
+    bool                     debug_info       = false;
+    bool                     profile          = false;
+    bool                     optimize         = false;
+    bool                     call_stack       = false;
+    std::size_t              inline_size      = 0;
+    bool                     merge_constants  = false;
+    bool                     relocate_data    = false;
+    bool                     annotate_listing = false;
+    DeadCodeMode             dead_code        = DeadCodeMode::Keep;
+    std::size_t              superopt_length  = 0;
+    std::string              superopt_path    = "mu0asm.superopt";
+    std::size_t              max_steps        = 100000000;
+    StatsReport              stats;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.size() > 2 && arg.compare(0, 2, "-j") == 0) {
+            if (!parse_count(arg.substr(2), thread_count))
+                return -1;
+        } else if (arg == "-o" || arg == "-d" || arg == "-j") {
+            if (i + 1 == argc) {
+                fatal("option '" << arg << "' expects an argument");
+                print_usage();
+                return -1;
+            }
+            std::string value = argv[++i];
+            if (arg == "-o") {
+                pattern = value;
+            } else if (arg == "-d") {
+                pattern = (std::filesystem::path(value) / "{name}.{ext}").string();
+            } else if (!parse_count(value, thread_count)) {
+                return -1;
+            }
+        } else if (arg == "--cache-dir" || arg == "--cache-size" || arg == "--max-steps" || arg == "--inline"
+                   || arg == "--superopt" || arg == "--superopt-db" || arg == "--stats-json") {
+            if (i + 1 == argc) {
+                fatal("option '" << arg << "' expects an argument");
+                print_usage();
+                return -1;
+            }
+            std::string value = argv[++i];
+            if (arg == "--cache-dir") {
+                cache_dir = value;
+            } else if (arg == "--superopt-db") {
+                superopt_path = value;
+            } else if (arg == "--stats-json") {
+                stats.json_path = value;
+            } else if (arg == "--superopt") {
+                if (!parse_count(value, superopt_length))
+                    return -1;
+            } else if (!parse_count(value, arg == "--cache-size" ? cache_mib : arg == "--inline" ? inline_size : max_steps)) {
+                return -1;
+            }
+        } else if (arg == "--call-stack") {
+            call_stack = true;
+        } else if (arg == "--blocks") {
+            annotate_listing = true;
+        } else if (arg == "--dead") {
+            dead_code = DeadCodeMode::Report;
+        } else if (arg == "--strip-dead") {
+            dead_code = DeadCodeMode::Remove;
+        } else if (arg == "--move-data") {
+            relocate_data = true;
+        } else if (arg == "--merge-constants") {
+            merge_constants = true;
+        } else if (arg == "-O") {
+            optimize = true;
+        } else if (arg == "--cpp") {
+            cpp = true;
+        } else if (arg == "--run") {
+            run = true;
+        } else if (arg == "--profile") {
+            run     = true;
+            profile = true;
+        } else if (arg == "--stats") {
+            stats.text = true;
+        } else if (arg == "-g") {
+            debug_info = true;
+        } else if (arg == "--watch") {
+            watch_input = true;
+        } else if (arg == "--version") {
+            std::cout << "mu0asm " << assembler_version() << std::endl;
+            return 0;
+        } else if (arg == "-h" || arg == "--help") {
+            print_usage();
+            return 0;
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            fatal("unknown option '" << arg << "'");
+            print_usage();
+            return -1;
+        } else {
+            inputs.push_back(std::move(arg));
+        }
+    }
+
+    if (inputs.empty()) {
         fatal("no input file specified");
         return -1;
     }
+    // before anything is assembled, and before any threads start
+    if (stats.text || !stats.json_path.empty()) {
+        enable_stats();
+    }
+    if (pattern.empty()) {
+        pattern = inputs.size() == 1 ? "a.{ext}" : "{name}.{ext}";
+    }
 
-    Parser parser(argv[1]);
-    if (parser.invalid()) {
-        fatal("errors occurred during initial parsing.");
+    std::vector<Job>      jobs(inputs.size());
+    std::set<std::string> outputs;
+    for (std::size_t i = 0; i < inputs.size(); ++i) {
+        jobs[i].input            = inputs[i];
+        jobs[i].out_path         = output_name(pattern, inputs[i], "out");
+        jobs[i].asm_path         = output_name(pattern, inputs[i], "asm");
+        jobs[i].max_steps        = run ? max_steps : 0;
+        jobs[i].optimize         = optimize;
+        jobs[i].inline_size      = inline_size;
+        jobs[i].merge_constants  = merge_constants;
+        jobs[i].relocate_data    = relocate_data;
+        jobs[i].annotate_listing = annotate_listing;
+        jobs[i].dead_code        = dead_code;
+        jobs[i].superopt_length  = superopt_length;
+        // a single file gets all threads for parsing it and for its
+        //  searches, more files are assembled in parallel already
+        jobs[i].superopt_threads = inputs.size() == 1 ? thread_count : 1;
+        jobs[i].parse_threads    = jobs[i].superopt_threads;
+        jobs[i].calls            = call_stack ? CallConvention::Stack : CallConvention::Inline;
+        if (cpp) {
+            jobs[i].cpp_path = output_name(pattern, inputs[i], "cpp");
+        }
+        if (debug_info) {
+            jobs[i].dbg_path = output_name(pattern, inputs[i], "dbg");
+        }
+        jobs[i].profile = profile;
+        if (!outputs.insert(jobs[i].out_path).second) {
+            fatal("more than one input would be written to '" << jobs[i].out_path
+                                                              << "', use '{name}' in the output pattern");
+            return -1;
+        }
+    }
+
+    if (run && max_steps == 0) {
+        fatal("--max-steps has to be at least 1");
         return -1;
-    } else {
-        log("initial parsing ok");
     }
 
-    parser.parse_all();
+    if (call_stack) {
+        const CallCost before = call_cost(CallConvention::Inline);
+        const CallCost after  = call_cost(CallConvention::Stack);
+        std::cerr << "calls take " << after.cycles << " cycles and " << after.words << " words each, instead of "
+                  << before.cycles << " cycles and " << before.words << " words" << std::endl;
+    }
 
-    parser.write_asm_to("a.asm");
-    parser.write_to("a.out");
+    SuperoptDatabase superopt_database;
+    if (superopt_length > 0) {
+        if (!superopt_database.load(superopt_path)) {
+            error("could not read '" << superopt_path << "'");
+        }
+        for (Job& job : jobs) {
+            job.superopt_database = &superopt_database;
+        }
+    }
+    auto save_superopt_database = [&] {
+        if (superopt_database.changed() && !superopt_database.save(superopt_path)) {
+            error("could not write '" << superopt_path << "'");
+        }
+    };
 
-    return 0;
+    if (watch_input) {
+        if (jobs.size() != 1) {
+            fatal("--watch takes a single input");
+            return -1;
+        }
+        // the incremental parser only keeps plain programs with inline
+        //  calls up to date, and doesn't use the cache. anything else
+        //  would be silently dropped
+        const Job& job = jobs.front();
+        if (job.calls == CallConvention::Stack || job.optimize || job.inline_size > 0 || job.merge_constants
+            || job.relocate_data || job.dead_code != DeadCodeMode::Keep || job.superopt_length > 0
+            || !job.cpp_path.empty() || job.max_steps != 0 || !cache_dir.empty()) {
+            fatal("--watch can't be combined with --call-stack, -O, --inline, --merge-constants, --move-data, "
+                  "--dead, --strip-dead, --superopt, --cpp, --run, --profile or --cache-dir");
+            return -1;
+        }
+        return watch(job);
+    }
+
+    std::unique_ptr<AssemblyCache> cache;
+    if (!cache_dir.empty()) {
+        cache = std::make_unique<AssemblyCache>(cache_dir, static_cast<std::uint64_t>(cache_mib) * 1024 * 1024);
+    }
+
+    if (jobs.size() == 1) {
+        // a single file is assembled right here, reporting errors as they happen
+        assemble(jobs.front(), cache.get());
+        if (!jobs.front().run_report.empty()) {
+            std::cout << jobs.front().input << ": " << jobs.front().run_report << std::endl;
+        }
+        save_superopt_database();
+        // the same as assemble_all, whether the file was on its own or not
+        return jobs.front().status == AssemblyStatus::Ok ? 0 : 1;
+    }
+    const int result = assemble_all(jobs, thread_count, cache.get());
+    save_superopt_database();
+    return result;
 }
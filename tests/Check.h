@@ -0,0 +1,26 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <iostream> // std::cerr
+#include <sstream>  // std::ostringstream
+
+// checks of the test programs. a failed check prints its message and is
+// counted, the program exits with the number of failed checks.
+
+inline int& failed_checks() {
+    static int failed = 0;
+    return failed;
+}
+
+#define check(condition, x)                                                        \
+    do {                                                                           \
+        if (!(condition)) {                                                        \
+            std::ostringstream check_stream;                                       \
+            check_stream << x;                                                     \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check '" #condition     \
+                      << "' failed: " << check_stream.str() << std::endl;          \
+            ++failed_checks();                                                     \
+        }                                                                          \
+    } while (false)
+
+#endif // CHECK_H
@@ -0,0 +1,62 @@
+#include <algorithm>   // std::copy_n
+#include <array>       // std::array
+#include <cstdint>     // std::uint...
+#include <string_view> // std::string_view
+#include <vector>      // std::vector
+
+#include "Assembler.h"
+#include "Check.h"
+#include "ConstantAssembler.h"
+
+// assemble_constant has a parser and call expansion of its own, so these
+// pin it to known images at compile time, and to what the assembler
+// itself makes of the same sources when run
+
+#define SIMPLE_SOURCE "lda $a\nadd $a\nstp\nd a = 21\n"
+#define CALL_SOURCE "jmp .start\n.double:\nadd $a\nret\n.start:\nlda $a\ncall .double\nstp\nd a = 5\n"
+#define NUMBERS_SOURCE "# comment\nlda 0x10\nsto 42 # also a comment\njge .l\n.l:\njne .l\nsub $b\nstp\nd b = 0xffff\n"
+
+static_assert(assemble_constant<SIMPLE_SOURCE>() == std::array<std::uint16_t, 4> { 0x0003, 0x2003, 0x7000, 0x0015 });
+// the call is expanded at 4 and returns to 11, through the data at 6
+static_assert(assemble_constant<CALL_SOURCE>()
+              == std::array<std::uint16_t, 13> { 0x4003, 0x200c, 0x4fff, 0x000c, 0x1ffe, 0x4007, 0x400b, 0x0006, 0x1fff,
+                                                 0x0ffe, 0x4001, 0x7000, 0x0005 });
+static_assert(assemble_constant<NUMBERS_SOURCE>()
+              == std::array<std::uint16_t, 7> { 0x0010, 0x102a, 0x5003, 0x6003, 0x3006, 0x7000, 0xffff });
+
+// whether Source assembles at compile time
+template <ConstantSource Source>
+concept assembles_constantly = requires { assemble_constant<Source>(); };
+
+// Line, Count times over
+template <ConstantSource Line, std::size_t Count>
+consteval auto repeated() {
+    constexpr std::string_view line = Line.view();
+    char                       text[line.size() * Count + 1] {};
+    for (std::size_t i = 0; i < Count; ++i) {
+        std::copy_n(line.data(), line.size(), text + i * line.size());
+    }
+    return ConstantSource(text);
+}
+
+// memory holds 4096 words, a longer program is an error like it is for
+//  Parser. a call takes 7 of them
+static_assert(assemble_constant<repeated<"stp\n", 4096>()>().size() == 4096);
+static_assert(!assembles_constantly<repeated<"stp\n", 4097>()>);
+static_assert(assemble_constant<repeated<"call 0\n", 585>()>().size() == 4095);
+static_assert(!assembles_constantly<repeated<"call 0\n", 586>()>);
+
+template <std::size_t N>
+static void check_same(const char* source, const std::array<std::uint16_t, N>& image) {
+    const AssemblyResult result = assemble(source);
+    check(result.ok(), "'" << source << "' doesn't assemble");
+    check(result.image == std::vector<std::uint16_t>(image.begin(), image.end()),
+          "'" << source << "' assembles to something else at compile time");
+}
+
+int main() {
+    check_same(SIMPLE_SOURCE, assemble_constant<SIMPLE_SOURCE>());
+    check_same(CALL_SOURCE, assemble_constant<CALL_SOURCE>());
+    check_same(NUMBERS_SOURCE, assemble_constant<NUMBERS_SOURCE>());
+    return failed_checks();
+}
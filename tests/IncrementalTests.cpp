@@ -0,0 +1,202 @@
+#include <cstddef>   // std::size_t
+#include <memory>    // std::unique_ptr
+#include <random>    // std::mt19937
+#include <string>    // std::string
+#include <vector>    // std::vector
+
+#include "Check.h"
+#include "Incremental.h"
+#include "Lexer.h"
+#include "Parser.h"
+
+// the incremental parser and the parser on several threads have to come to
+// the same result as the parser does on its own. random edits are made to a
+// program, and after each one both are compared with a fresh parser
+
+namespace {
+constexpr std::size_t   EDITS = 2000;
+constexpr std::uint32_t SEED  = 12345;
+
+// lines edits are made of. some of them declare a label or data a second
+//  time, refer to ones that aren't there, or aren't valid at all
+const char* const g_lines[] = {
+    "lda $n",
+    "sub $one",
+    "add $one",
+    "sto $n",
+    "jne .loop",
+    "jge .end",
+    "jmp .loop",
+    "jmp .end",
+    "call .sub",
+    "ret",
+    "stp",
+    ".loop:",
+    ".end:",
+    ".sub:",
+    "d n = 10",
+    "d one = 1",
+    "d two = 0x2",
+    "lda $two",
+    "lda $missing",
+    "jmp .missing",
+    "",
+    "# a comment",
+    "lda",
+    "nop $n",
+};
+
+const char* const g_program[] = {
+    "lda $n",
+    ".loop:",
+    "sub $one",
+    "sto $n",
+    "jne .loop",
+    "call .sub",
+    "jmp .end",
+    ".sub:",
+    "add $one",
+    "ret",
+    ".end:",
+    "stp",
+    "d n = 10",
+    "d one = 1",
+};
+
+std::string join(const std::vector<std::string>& lines, bool last_newline) {
+    std::string source;
+    for (std::size_t i = 0; i < lines.size(); ++i) {
+        source += lines[i];
+        if (i + 1 < lines.size() || last_newline) {
+            source += "\n";
+        }
+    }
+    return source;
+}
+
+std::vector<std::string> diagnostics_of(const Parser& parser) {
+    std::vector<std::string> out;
+    for (const Diagnostic& diagnostic : parser.diagnostics()) {
+        out.push_back(std::to_string(diagnostic.loc.line) + ":" + std::to_string(diagnostic.loc.column) + " " + diagnostic.message);
+    }
+    return out;
+}
+
+std::string lines_of(const std::vector<std::string>& diagnostics) {
+    std::string out;
+    for (const std::string& diagnostic : diagnostics) {
+        out += "  " + diagnostic + "\n";
+    }
+    return out;
+}
+
+void check_same(const Parser& parser, const std::string& source, std::size_t edit) {
+    SourceBuffer buffer;
+    buffer.assign(source);
+    Parser fresh(std::move(buffer));
+    if (!fresh.invalid()) {
+        fresh.parse_all();
+    }
+    check(parser.invalid() == fresh.invalid(), "edit " << edit << " is " << (fresh.invalid() ? "invalid" : "valid") << " only when parsed fresh:\n"
+                                                       << source);
+    check(diagnostics_of(parser) == diagnostics_of(fresh), "edit " << edit << " has other diagnostics than when parsed fresh:\n"
+                                                                   << lines_of(diagnostics_of(parser)) << "instead of\n"
+                                                                   << lines_of(diagnostics_of(fresh)) << "for\n"
+                                                                   << source);
+    if (!fresh.invalid()) {
+        check(parser.image() == fresh.image(), "edit " << edit << " has another image than when parsed fresh:\n"
+                                                       << source);
+    }
+}
+
+std::size_t pick(std::mt19937& random, std::size_t n) {
+    return static_cast<std::size_t>(random() % n);
+}
+
+// replaces, inserts or removes a line, or the newline at the end
+void edit_lines(std::vector<std::string>& lines, bool& last_newline, std::mt19937& random) {
+    const std::size_t pool = std::size(g_lines);
+    switch (pick(random, 8)) {
+    case 0:
+    case 1:
+    case 2:
+        if (!lines.empty()) {
+            lines[pick(random, lines.size())] = g_lines[pick(random, pool)];
+            break;
+        }
+        [[fallthrough]];
+    case 3:
+    case 4:
+    case 5:
+        lines.insert(lines.begin() + static_cast<std::ptrdiff_t>(pick(random, lines.size() + 1)), g_lines[pick(random, pool)]);
+        break;
+    case 6:
+        if (!lines.empty()) {
+            lines.erase(lines.begin() + static_cast<std::ptrdiff_t>(pick(random, lines.size())));
+        }
+        break;
+    default:
+        last_newline = !last_newline;
+        break;
+    }
+    // keeps the program from growing without end
+    if (lines.size() > 60) {
+        lines.erase(lines.begin() + static_cast<std::ptrdiff_t>(pick(random, lines.size())));
+    }
+}
+
+void check_incremental() {
+    std::mt19937             random(SEED);
+    std::vector<std::string> lines(std::begin(g_program), std::end(g_program));
+    bool                     last_newline = true;
+    IncrementalParser        parser(join(lines, last_newline));
+    // most edits leave an error in, so they are mostly undone again, to
+    //  also get far from the start without one
+    std::vector<std::string> last_valid = lines;
+    for (std::size_t edit = 0; edit < EDITS; ++edit) {
+        if (parser.invalid() && pick(random, 4) != 0) {
+            lines = last_valid;
+        } else {
+            edit_lines(lines, last_newline, random);
+        }
+        const std::string source = join(lines, last_newline);
+        parser.update(source);
+        check_same(parser, source, edit);
+        if (failed_checks() > 0) {
+            return;
+        }
+        if (!parser.invalid()) {
+            last_valid = lines;
+        }
+    }
+}
+
+// a source big enough to be split into parts, with an error near the end
+void check_threads() {
+    std::string source;
+    for (std::size_t i = 0; source.size() < 1024 * 1024; ++i) {
+        const std::string n = std::to_string(i);
+        source += ".l" + n + ":\nlda $d" + n + "\nadd $d" + n + "\njne .l" + n + "\ncall .sub\nd d" + n + " = " + n + "\n";
+    }
+    source += ".sub:\nret\njmp .missing\nstp\n";
+    auto parse = [&](std::size_t threads) {
+        SourceBuffer buffer;
+        buffer.assign(source);
+        auto parser = std::make_unique<Parser>(std::move(buffer), CallConvention::Inline, threads);
+        if (!parser->invalid()) {
+            parser->parse_all();
+        }
+        return parser;
+    };
+    const auto serial   = parse(1);
+    const auto parallel = parse(4);
+    check(serial->image() == parallel->image(), "the image on 4 threads differs from the one on 1");
+    check(diagnostics_of(*serial) == diagnostics_of(*parallel), "the diagnostics on 4 threads differ from the ones on 1");
+}
+}
+
+int main() {
+    check_incremental();
+    check_threads();
+    return failed_checks();
+}
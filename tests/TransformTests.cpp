@@ -0,0 +1,203 @@
+#include <cstdint> // std::uint...
+#include <string>  // std::string
+#include <vector>  // std::vector
+
+#include "Assembler.h"
+#include "Check.h"
+#include "Machine.h"
+
+// every transform of the assembler has to leave what a program does as it
+// is. each program here is run as assembled plain and with every
+// transform, and has to stop with the same acc every time
+
+namespace {
+struct Program {
+    const char* name;
+    const char* source;
+    // acc once it stopped
+    std::uint16_t acc;
+    // notes of --dead, 0 if it finds nothing
+    std::size_t dead_notes;
+    // false if it only works with CallConvention::Inline
+    bool stack_calls = true;
+};
+
+struct Variant {
+    const char*     name;
+    AssemblyOptions options;
+};
+
+constexpr std::uint64_t MAX_STEPS = 100000;
+
+const Program g_programs[] = {
+    { "loop",
+      "lda $n\n"
+      ".loop:\n"
+      "sub $one\n"
+      "sto $n\n"
+      "jne .loop\n"
+      "lda $n\n"
+      "add $five\n"
+      "stp\n"
+      "d n = 10\n"
+      "d one = 1\n"
+      "d five = 5\n",
+      5, 0 },
+    { "subroutine",
+      "jmp .start\n"
+      "d a = 2\n"
+      "d one = 1\n"
+      ".inc:\n"
+      "lda $a\n"
+      "add $one\n"
+      "sto $a\n"
+      "ret\n"
+      ".start:\n"
+      "call .inc\n"
+      "call .inc\n"
+      "lda $a\n"
+      "stp\n",
+      4, 0 },
+    // the call goes to a number, so nothing may move
+    { "numeric call",
+      "jmp .start\n"
+      "d a = 5\n"
+      "d one = 1\n"
+      "d one2 = 1\n"
+      "lda $a\n"
+      "add $one2\n"
+      "sto $a\n"
+      "ret\n"
+      ".start:\n"
+      "call 0x4\n"
+      "lda $a\n"
+      "stp\n",
+      6, 0, false },
+    // x is run as `jmp 3`, so nothing after it may move either
+    { "jump into data",
+      "jmp $x\n"
+      "dx x = 0x4003\n"
+      "jmp .end\n"
+      "lda $v\n"
+      "add $v\n"
+      "stp\n"
+      ".end:\n"
+      "stp\n"
+      "d v = 7\n",
+      14, 0 },
+    // an unused subroutine and data, a note each and the summary
+    { "dead code",
+      "jmp .start\n"
+      ".unused:\n"
+      "lda $a\n"
+      "add $a\n"
+      "stp\n"
+      ".start:\n"
+      "lda $a\n"
+      "add $b\n"
+      "stp\n"
+      "d a = 3\n"
+      "d b = 4\n"
+      "d c = 9\n",
+      7, 3 },
+    // the last instruction runs on through empty memory, back to the start.
+    //  data moved behind it would run before that, and stop too early
+    { "falls off the end",
+      "lda $flag\n"
+      "jne .done\n"
+      "jmp .go\n"
+      ".done:\n"
+      "lda $stop\n"
+      "stp\n"
+      ".go:\n"
+      "lda $one\n"
+      "sto $flag\n"
+      "jmp .end\n"
+      "d flag = 0\n"
+      "d one = 1\n"
+      "d stop = 0x7000\n"
+      ".end:\n"
+      "lda $one\n"
+      "add $one\n",
+      0x7000, 0 },
+};
+
+std::vector<Variant> variants(CallConvention calls) {
+    std::vector<Variant> result;
+    auto                 add = [&](const char* name, auto&& set) {
+        Variant variant { name, {} };
+        variant.options.calls = calls;
+        set(variant.options);
+        result.push_back(variant);
+    };
+    add("plain", [](AssemblyOptions&) {});
+    add("-O", [](AssemblyOptions& options) { options.optimize = true; });
+    add("--inline 8", [](AssemblyOptions& options) { options.inline_size = 8; });
+    add("--merge-constants", [](AssemblyOptions& options) { options.merge_constants = true; });
+    add("--move-data", [](AssemblyOptions& options) { options.relocate_data = true; });
+    add("--strip-dead", [](AssemblyOptions& options) { options.dead_code = DeadCodeMode::Remove; });
+    add("--superopt 3", [](AssemblyOptions& options) { options.superopt_length = 3; });
+    add("all of them", [](AssemblyOptions& options) {
+        options.optimize        = true;
+        options.inline_size     = 8;
+        options.merge_constants = true;
+        options.relocate_data   = true;
+        options.dead_code       = DeadCodeMode::Remove;
+        options.superopt_length = 3;
+    });
+    return result;
+}
+
+void check_program(const Program& program, CallConvention calls) {
+    const char* convention = calls == CallConvention::Stack ? "stack" : "inline";
+    for (const Variant& variant : variants(calls)) {
+        const AssemblyResult result = assemble(program.source, variant.options);
+        check(result.ok(), program.name << " (" << convention << ", " << variant.name << ") doesn't assemble");
+        if (!result.ok()) {
+            continue;
+        }
+        Machine machine;
+        check(machine.load(result.image), program.name << " (" << convention << ", " << variant.name << ") doesn't fit");
+        const RunResult run = machine.run(MAX_STEPS);
+        check(run.reason == StopReason::Stopped,
+              program.name << " (" << convention << ", " << variant.name << ") doesn't stop, pc = " << run.pc);
+        check(run.acc == program.acc, program.name << " (" << convention << ", " << variant.name << ") stops with acc = "
+                                                   << run.acc << ", not " << program.acc);
+    }
+}
+
+// --dead may only find something where everything that runs is known
+void check_dead_code(const Program& program) {
+    AssemblyOptions options;
+    options.dead_code            = DeadCodeMode::Report;
+    const AssemblyResult result  = assemble(program.source, options);
+    check(result.notes.size() == program.dead_notes, program.name << " has " << result.notes.size()
+                                                                   << " notes about dead code, not " << program.dead_notes);
+}
+
+// a program of words words, which fits into memory up to 4096
+void check_size(std::size_t words) {
+    std::string source;
+    for (std::size_t i = 2; i < words; ++i) {
+        source += "ADD $a\n";
+    }
+    source += "STP\nd a = 1\n";
+    const AssemblyResult result = assemble(source, AssemblyOptions {});
+    const bool           fits   = words <= Machine::MEMORY_WORDS;
+    check((result.status == AssemblyStatus::Ok) == fits, "a program of " << words << " words " << (fits ? "doesn't assemble" : "assembles"));
+    check(result.diagnostics.size() == (fits ? 0 : 1), "a program of " << words << " words has " << result.diagnostics.size() << " errors");
+}
+}
+
+int main() {
+    for (const Program& program : g_programs) {
+        check_program(program, CallConvention::Inline);
+        if (program.stack_calls) {
+            check_program(program, CallConvention::Stack);
+        }
+        check_dead_code(program);
+    }
+    check_size(Machine::MEMORY_WORDS);
+    check_size(Machine::MEMORY_WORDS + 1);
+    return failed_checks();
+}